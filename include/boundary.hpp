@@ -0,0 +1,114 @@
+#pragma once
+
+#ifndef BOUNDARY_HPP
+#define BOUNDARY_HPP
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+/**
+ * @brief The resolved block boundaries shared by all of the block handlers.
+ *
+ * The input is cut into blocks at the proposed offsets first + i * block_size; block i is [proposed(i), proposed(i+1)).
+ * Each proposed offset has to be moved back to the start of the key run that contains it, and since the end of block i
+ * is the beginning of block i+1 that is done here once, by whichever neighbor gets to it first, and published to both.
+ *
+ * Boundaries are claimed with a compare and swap; a handler that needs a boundary another handler is resolving waits
+ * for it to be published.  A published boundary also records the key at its proposed offset, which lets the next
+ * boundary be resolved with a single probe when it falls in the same run (a homogeneous block), or be bisected from the
+ * previous proposed offset instead of from the start of the file.
+ */
+class BoundaryTable {
+    public:
+        static constexpr long UNRESOLVED = -3;                  ///> nobody has claimed the boundary.
+        static constexpr long BUSY = -2;                        ///> a handler is resolving the boundary.
+        static constexpr long FAILED = -1;                      ///> the boundary could not be resolved.
+
+        /**
+         * @brief Construct the table for nblocks blocks.
+         *
+         * @param first the offset of the first block (just past the header).
+         * @param size the size of the input; the last boundary is published as size.
+         * @param nblocks the number of blocks.
+         * @param block_size the distance between the proposed offsets.
+         */
+        BoundaryTable( long first, long size, long nblocks, long block_size );
+
+        /**
+         * @brief The index of the boundary proposed at offset, or -1 if offset is not a proposed boundary.
+         */
+        long index( long offset ) const;
+
+        /**
+         * @brief The proposed offset of boundary i.
+         */
+        long proposed( long i ) const;
+
+        /**
+         * @brief Claim boundary i for resolving.
+         *
+         * @return true when the caller must resolve and publish it; false when another handler has it.
+         */
+        bool claim( long i );
+
+        /**
+         * @brief Publish the run start of boundary i and the key at its proposed offset.
+         *
+         * @param offset the start of the key run, or FAILED.
+         * @param key the key of that run.
+         * @param searched true if a search was needed; false if a neighbor's key resolved it.
+         */
+        void publish( long i, long offset, const std::string& key, bool searched );
+
+        /**
+         * @brief Wait until boundary i is published.
+         *
+         * @return the start of the key run, or FAILED.
+         */
+        long wait( long i );
+
+        /**
+         * @brief Get boundary i if it has been published, without waiting.
+         *
+         * @param offset set to the start of the key run.
+         * @param key set to the key of that run.
+         * @return true when the boundary is published; false otherwise.
+         */
+        bool peek( long i, long& offset, std::string& key ) const;
+
+        /**
+         * @brief The number of boundaries that needed a search.
+         */
+        long searches( void ) const;
+
+        /**
+         * @brief The number of boundaries resolved from a neighbor's key.
+         */
+        long shortcuts( void ) const;
+
+        /**
+         * @brief The number of times a handler waited for a neighbor to publish.
+         */
+        long waits( void ) const;
+
+    private:
+        /**
+         * @brief One boundary; key is written before offset is published and never changes afterwards.
+         */
+        struct Entry {
+            std::atomic<long> offset;
+            std::string key;
+        };
+
+        long first_;
+        long size_;
+        long count_;                                            ///> nblocks + 1 boundaries.
+        long block_size_;
+        std::unique_ptr<Entry[]> entries_;
+        std::atomic<long> searches_;
+        std::atomic<long> shortcuts_;
+        std::atomic<long> waits_;
+};
+
+#endif
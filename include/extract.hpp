@@ -0,0 +1,94 @@
+#pragma once
+
+#ifndef EXTRACT_HPP
+#define EXTRACT_HPP
+
+#include <string>
+#include <vector>
+#include "filesplitter.hpp"
+#include "keymodel.hpp"
+
+/**
+ * @brief Finds the bytes of one key, or of a range of keys, in a sorted input without reading the rest of it.
+ *
+ * The keys are compared in the order the input is sorted in: as text, or as numbers / timestamps when the key is typed
+ * (keys that do not parse as the type are compared as text).  Each bound is a bisection over byte offsets where every
+ * probe reads one record with the block handler's key extractor, so a bound costs about log2(records) probes.  The run
+ * of a single key is then measured with the handler's galloping run search from its first record.
+ *
+ * A batch of keys is looked up in one pass: the bounds of all of the keys are searched together, and every probe
+ * splits both the byte interval and the keys still looking in it.  The top of the search is shared by all of the keys,
+ * so the probes grow with the number of distinct search paths (about K log2(N/K) for K keys and N records) instead of
+ * K log2(N).
+ */
+class Extractor {
+    public:
+        /**
+         * @brief Construct an extractor.
+         *
+         * @param handler the (open) block handler used for the probes.
+         * @param begin the first byte of the data (just past the header).
+         * @param end the size of the input.
+         * @param type how the keys are ordered.
+         * @param logger the logger the searches are written to.
+         */
+        Extractor( BlockHandler& handler, long begin, long end, KeyModel::Type type, FileSplitter::LogPtr logger );
+
+        /**
+         * @brief The start of the first record whose key is not less than key (after false) or greater than key (after
+         * true); end when there is none.
+         *
+         * @return the byte offset, or -1 on error.
+         */
+        long bound( const std::string& key, bool after );
+
+        /**
+         * @brief Find the records with keys in [first, last].
+         *
+         * @param soff set to the start of the first of them.
+         * @param len set to their length in bytes; 0 when there are none.
+         * @return true on success; false on a read error.
+         */
+        bool range( const std::string& first, const std::string& last, long& soff, long& len );
+
+        /**
+         * @brief Find the records of each of a batch of keys.
+         *
+         * @param keys the keys; they are sorted into the input's order and duplicates are removed.
+         * @param begins set to the start of the run of each key.
+         * @param lengths set to the length of the run of each key; 0 when the key is not in the input.
+         * @return true on success; false on a read error.
+         */
+        bool lookup( std::vector<std::string>& keys, std::vector<long>& begins, std::vector<long>& lengths );
+
+        /**
+         * @brief Compare two keys in the input's order; < 0, 0 or > 0 as a is before, the same as or after b.
+         */
+        int compare( const std::string& a, const std::string& b ) const;
+
+        /**
+         * @brief The number of records read by the searches.
+         */
+        long probes( void ) const;
+
+    private:
+        /**
+         * @brief One bound of a batch lookup: the first record whose key is not less than (or greater than) key.
+         */
+        struct Query {
+            const std::string* key;
+            bool after;
+            long answer;
+        };
+
+        BlockHandler& handler_;
+        long begin_;
+        long end_;
+        KeyModel::Type type_;
+        FileSplitter::LogPtr logger_;
+        long probes_;
+
+        bool resolve( std::vector<Query>::iterator first, std::vector<Query>::iterator last, long lo, long hi );
+};
+
+#endif
@@ -6,8 +6,20 @@
 #include <mutex> 
 #include <cstdio>
 #include "tool.hpp"
+#include "inputsource.hpp"
+#include "scan.hpp"
+#include "transfer.hpp"
+#include "uring.hpp"
+#include "scheduler.hpp"
+#include "pipeline.hpp"
+#include "boundary.hpp"
 #include "spdlog/spdlog.h"
 
+class KeyModel;
+class KeyIndex;
+class Manifest;
+class KeySliceReader;
+
 /**
  * @brief predicate indicating whether a file exists on the filesystem.
  *
@@ -26,6 +38,34 @@ bool fileExists( const std::string& fn );
  */
 bool dirExists( const std::string& dn );
 
+/**
+ * @brief predicate indicating whether a file can be read at random offsets (a regular file or a block device).
+ *
+ * @param fn the file name and path; "-" is stdin, which is never seekable here.
+ *
+ * @return true if it can, or if it does not exist; false otherwise.
+ */
+bool seekable( const std::string& fn );
+
+/**
+ * @brief The run time settings, taken from the command line, that are shared by all block handlers.
+ */
+struct SplitConfig {
+    InputSource::Kind input;                                    ///> the backend used to read the input during searches.
+    long mapmax;                                                ///> the largest mapping (bytes) the MMAP backend will make.
+    Transfer::Method transfer;                                  ///> the first copy method the transfers try.
+    unsigned uring;                                             ///> io_uring queue depth (outputs in flight); 0 is off.
+    long chunk;                                                 ///> larger key runs are copied in chunks this size (bytes); 0 is off.
+    long maxpart;                                               ///> larger key runs are written as parts of at most this size (bytes); 0 is off.
+    SearchStrategy search;                                      ///> how the key runs in a block are enumerated.
+    unsigned kary;                                              ///> probes per boundary search round (k-ary search); < 3 is bisection.
+    long cache;                                                 ///> the probe cache size (bytes) of the PREAD backend.
+    ProbeStats* stats;                                          ///> where the block handlers add their search statistics.
+    const KeyModel* model;                                      ///> predicts the boundaries of a typed key; nullptr is off.
+    const KeyIndex* index;                                      ///> the sidecar key index; nullptr is off.
+    Manifest* manifest;                                         ///> plan mode: key runs are added here instead of copied; nullptr is off.
+};
+
 /**
  * A class that performs multithreaded file split operations.
  */
@@ -95,11 +135,53 @@ class FileSplitter : public tool::Tool {
         /**
          * Splits the file.
          *
-         * @param filename the file to split.
+         * @param plan true to only find the key runs and write them to the manifest (the plan command).
+         *
+         * @return the program exit status.
+         */
+        int splitFile( bool plan = false );
+
+        /**
+         * Builds (or rebuilds) the sidecar key index of the file for the index command.
+         *
+         * @return the program exit status.
+         */
+        int indexFile( void );
+
+        /**
+         * Writes the header and the records of one key, or of a range of keys, of the file for the extract command.
+         *
+         * @return the program exit status.
+         */
+        int extractFile( void );
+
+        /**
+         * Splits an input that can only be read once, in order (stdin as "-", a FIFO or a character device).
+         *
+         * @return the program exit status.
+         */
+        int streamFile( void );
+
+        /**
+         * Splits a file that is not sorted by key (-U), or into hash partitions (-P).
+         *
+         * @return the program exit status.
+         */
+        int scatterFile( void );
+
+        /**
+         * Splits a sorted file into -S N shards of about the same size, cut only at key boundaries.
+         *
+         * @return the program exit status.
+         */
+        int shardFile( void );
+
+        /**
+         * Writes the records of each key listed in a file, found in one batched search, for the lookup command.
          *
          * @return the program exit status.
          */
-        int splitFile( void );
+        int lookupFile( void );
 
     private:
         std::string ifname_;                                     ///> the name of the file to split.
@@ -108,7 +190,14 @@ class FileSplitter : public tool::Tool {
         std::string header_;                                     ///> the header line of the file or the empty string if no header.
         LogPtr logger_;                                          ///> multithreaded logger.
         std::vector<uint32_t> keylist_;                          ///> Contains the indices of the colums to use as keys.
+        SplitConfig config_;                                     ///> settings shared with the block handlers.
+        ProbeStats stats_;                                       ///> search statistics of the run.
 
+        bool initInputSource( void );
+        bool initRun( std::size_t operand, bool seekable = true );
+        long indexInterval( void );
+        bool writeManifest( Manifest& manifest );
+        bool sliceRange( const KeySliceReader& reader, const std::string& first, const std::string& last, long& soff, long& len );
         bool initOutputDirectory( std::string& odname );
         long initInputFile( std::string& ifname, std::string& header );
 };
@@ -116,10 +205,13 @@ class FileSplitter : public tool::Tool {
 /**
  * Functor for finding and writing blocks in a thread.
  * Good link on copy options: http://stackoverflow.com/questions/10195343/copy-a-file-in-a-sane-safe-and-efficient-way
+ * The copies themselves are done by a Transfer engine, in the kernel when possible.
  */
 class BlockHandler {
     public:
         static constexpr int BUFSIZE = 8 * 1024;                ///> 8k seems a good buffer size.
+        static constexpr int PAGESIZE = 4 * 1024;               ///> window size for the backward record start scan.
+        static constexpr size_t MEMOSIZE = 1024;                ///> entries in the (record start, key) memo.
         
         /**
          * @param ifname the name of the file.
@@ -127,8 +219,14 @@ class BlockHandler {
          * @param header header to append to all blocks; could be the empty string.
          * @param begin byte offset of the "proposed" beginning of the data portion of the block (will never include header).
          * @param end byte offset of the "proposed" end of the block; could be the last byte in the file.
+         * @param config the settings that select the input backend.
          */
-        BlockHandler( const std::string& ifname, const std::string& odname, long ifsize, const std::string& header, FileSplitter::LogPtr logger, const std::vector<uint32_t>& keylist );
+        BlockHandler( const std::string& ifname, const std::string& odname, long ifsize, const std::string& header, FileSplitter::LogPtr logger, const std::vector<uint32_t>& keylist, const SplitConfig& config );
+
+        /**
+         * @brief Block handlers own their input view, so they are moved (not copied) into their threads.
+         */
+        BlockHandler( BlockHandler&& ) = default;
 
         /**
          * @brief Destroy the block handler.
@@ -162,6 +260,9 @@ class BlockHandler {
          *    a. update bpos = jp
          *    b. jump toward the end: jp = floor((jp+epos)/2); goto 5. 
          *
+         * That is the BISECT search strategy.  With GALLOP the runs are instead enumerated forward from begin with
+         * findNextRun, so each search costs about log(run length) probes and the runs are written in file order.
+         *
          * Expected Results for Special Cases:
          *
          * 1. When file is entirely of one key, the thread with end == EOF will write a copy of the entire file; all
@@ -169,37 +270,99 @@ class BlockHandler {
          * 2. All homogeneous blocks will do nothing
          */
         void operator()( long begin, long end );
+
+        /**
+         * @brief Handle the block [begin, end) with the given search strategy (AUTO is treated as GALLOP).
+         */
+        void operator()( long begin, long end, SearchStrategy search );
+
+        /**
+         * @brief Execute the thread as a worker of scheduler: run BLOCK and RUN tasks until all of the work is done.
+         *
+         * While any worker is idle, the key runs this worker finds are handed off as RUN tasks instead of being written
+         * here, so idle workers take over the copying while this one keeps searching.
+         *
+         * With a pipeline, this worker only searches: every key run (and every chunk of a large one) is pushed to the
+         * pipeline for the write workers.
+         *
+         * The begin and end of each BLOCK task are resolved through boundaries, so each boundary is searched for once and
+         * shared with the neighboring block.
+         *
+         * @param scheduler the scheduler holding the tasks.
+         * @param worker the index of this worker in the scheduler.
+         * @param pipeline the queue to the write workers, or nullptr to write here.
+         * @param boundaries the boundaries shared by the workers, or nullptr to resolve every block alone.
+         */
+        void operator()( Scheduler& scheduler, unsigned worker, Pipeline* pipeline, BoundaryTable* boundaries );
+
+        /**
+         * @brief Execute the thread as a write worker: copy the RUN and CHUNK tasks in pipeline until it is finished.
+         */
+        void operator()( Pipeline& pipeline );
+
+        /**
+         * @brief Open the input view and the transfer engines; operator() does this on first use.
+         *
+         * @return true on success; false otherwise.
+         */
+        bool open( void );
+
+        /**
+         * @brief Finish any queued outputs and close the input.
+         */
+        void close( void );
         
         /**
-         * @brief Set the position in a file (inf), to the beginning of the current record and return the byte offset of that
-         * position.
+         * @brief Find the byte offset of the beginning of the record that contains the byte at soff.
          *
-         * If start <= begin, the file will be positioned at start (this is an abnormal parameter setting).
-         * If start or begin is less than 0 it will be set to 0.
+         * If soff is within the header, soff is returned (this is an abnormal parameter setting).
+         * If soff is less than 0 it will be set to 0.
          * If start is greater than the size of the file (or within the last record), the start of the last record will be
          * returned.
          *
-         * @param inf the file pointer to set; it is expected to be open.
          * @param soff the position in the file from which to start the search; start should be >= 0.
          * @return the byte offset of the start of the record the parameter was within, or -1 on error.
          */
-        long setRecordStartOffset( FILE* inf, long soff );
+        long setRecordStartOffset( long soff );
 
         /**
          * @brief Extract the record key from the record designated by spos return it along with the byte offset of the first
          * byte in that key.
          *
-         * @param f the file to identify the key within.
-         * @param soff the starting search byte offset within f; this can be anywhere within the record of interest.
+         * @param soff the starting search byte offset within the input; this can be anywhere within the record of interest.
          * @param key location to set the key (this is modified by the method).
          * @return long the byte offset of the first character in key (the beginning of the record).
          */
-        long setRecordKey( FILE* f, long soff, std::string& key );
-        long setRecordMultiKey( FILE* f, long soff, std::string& key );
+        long setRecordKey( long soff, std::string& key );
+        long setRecordMultiKey( long soff, std::string& key );
+
+        /**
+         * @brief Locate the keylist_ fields of the record that includes the byte at soff.
+         *
+         * The fields are spans into the input view, so they are only valid until the next probe.
+         *
+         * @param soff the starting search byte offset within the input; this can be anywhere within the record of interest.
+         * @param fields set to the key fields (this is modified by the method).
+         * @return the byte offset of the beginning of the record, or -1 on error.
+         */
+        long setRecordFields( long soff, std::vector<scan::Span>& fields );
+
+        /**
+         * @brief Compare the key of the record that includes the byte at soff with key.
+         *
+         * With the PREAD backend the (record start, key) pairs of earlier probes are remembered, so probing a record again
+         * costs no read and no key extraction.
+         *
+         * @param soff the starting search byte offset within the input; this can be anywhere within the record of interest.
+         * @param key the key to compare with.
+         * @param same set to true when the record has key.
+         * @return the byte offset of the beginning of the record, or -1 on error.
+         */
+        long probeKey( long soff, const std::string& key, bool& same );
 
         /**
-         * @brief Return the byte offset of the first record in f having the same key as the record that includes the byte at
-         * soff. In other words, soff can be anywhere in a record (start, ending \n, etc).
+         * @brief Return the byte offset of the first record in the input having the same key as the record that includes
+         * the byte at soff. In other words, soff can be anywhere in a record (start, ending \n, etc).
          *
          * Steps:
          *
@@ -208,22 +371,110 @@ class BlockHandler {
          * key moving forward in the file.
          * 3. Return the offset of the first byte of that first record.
          *
-         * @param f the file to search.
-         * @param soff the byte offset in f to start and identify the key to search for.
-         * @param begin the absolute beginning byte offset in f.
-         * @param end the absoute end byte offset in f.
+         * With a k-ary search (config kary = k > 2) each round first starts the reads of k-1 evenly spaced probes at once
+         * and then narrows the interval to the gap between two of them, so the interval shrinks by a factor of k for one
+         * round trip to the storage instead of log2(k).  The last few pages are bisected as before.
+         *
+         * With a typed key model (config model) the search first probes just before and just after the offset the model
+         * predicts for the key; when the prediction is good those two probes leave only the model's error to search.
          *
-         * @return the byte offset of the first record in f having the required key.
+         * @param soff the byte offset in the input to start and identify the key to search for.
+         * @param end the absoute end byte offset in the input.
+         * @param lower an offset known to be before the first record (in a record with another key, or the first record
+         * itself); the search does not look before it.  0 searches from the header.
+         *
+         * @return the byte offset of the first record in the input having the required key.
          * @note bkey_ will contain the key for the first record (it is private)
          */
-        long findFirstRecord( FILE* f, long soff, long end );
+        long findFirstRecord( long soff, long end, long lower = 0 );
+
+        /**
+         * @brief Resolve boundary i of the shared boundary table to the start of the key run containing it.
+         *
+         * The key at the proposed offset is compared with the published neighbors first: when it matches one of them the
+         * boundary is in the same run and no search is needed.  Otherwise the search starts at the previous proposed
+         * offset when that one is published.  If another handler is resolving the boundary, this waits for its result.
+         *
+         * @return the byte offset of the start of the run, or -1 on error.
+         */
+        long resolveBoundary( long i );
+
+        /**
+         * @brief Return the byte offset of the first record after soff whose key differs from the key of the record at
+         * soff; that is, the end of the key run that starts at soff.
+         *
+         * The search gallops forward from soff, doubling its stride (starting at one record) until it finds another key,
+         * and then bisects only within that bracket; its cost depends on the length of the run, not on end - soff.  With
+         * a typed key model the first two probes go on both sides of the predicted end of the run; the gallop only runs
+         * when they miss.
+         *
+         * @param soff the byte offset of the start of a key run.
+         * @param end the byte offset where the search stops; it must be a run boundary (or the end of the file).
+         * @return the byte offset of the end of the run (at most end), or -1 on error.
+         * @note bkey_ will contain the key of the run.
+         */
+        long findNextRun( long soff, long end );
+
+        /**
+         * @brief Same as findNextRun, but reads every record from soff until the key changes.
+         *
+         * This is cheaper than searching when the runs are only a few records long.
+         */
+        long scanNextRun( long soff, long end );
 
         /**
-         * NOTE: This is faster than using c++ streams.  Not by much, but the code is almost the same when you have to slice
-         * out of the file.
+         * @brief The length of the record that starts at rsoff, including its record delimiter.
+         *
+         * @return the length in bytes, or -1 on error.
+         */
+        long recordLength( long rsoff );
+
+        /**
+         * @brief Write the header and the input bytes [soff, soff+bytes_to_write) to the file ofn.
+         *
+         * The thread's Transfer engine keeps the input open across keys and copies with copy_file_range (falling back to
+         * sendfile, splice and then pread/pwrite), so the bytes do not pass through user space.  When the io_uring output
+         * engine is on, the output is only queued here and finished later.
+         *
+         * @return the number of input bytes written or queued (the header is not counted), or -1 on error.
          */
         long transfer( long soff, long bytes_to_write, const std::string& ofn );
 
+        /**
+         * @brief Write the key run [soff, soff+len) to the output file for key, or hand it to an idle worker.
+         *
+         * @return the number of input bytes written or handed off, or -1 on error.
+         */
+        long writeRun( const std::string& key, long soff, long len );
+
+        /**
+         * @brief Write a key run that is larger than the chunk size with the help of the other workers.
+         *
+         * The output is created with its header and preallocated to its final size; this worker copies the first chunk
+         * and the rest are pushed as CHUNK tasks that any worker can copy at their precomputed output offsets.
+         *
+         * @return the number of input bytes written or handed off, or -1 on error.
+         */
+        long writeChunked( const std::string& key, long soff, long len );
+
+        /**
+         * @brief Write a key run that is larger than the maximum output size as the parts key.part-0000, key.part-0001, ...
+         *
+         * The cuts are the record starts found by the backward record start scan from every maxpart bytes less the
+         * header, so each part holds whole records and, with its header, is at most maxpart bytes (unless it is one
+         * longer record, which is logged).
+         * The parts are handed to the write workers, or pushed for the other workers to steal, so they are written in
+         * parallel.
+         *
+         * @return the number of input bytes written or handed off, or -1 on error.
+         */
+        long writeParts( const std::string& key, long soff, long len );
+
+        /**
+         * @brief The name of the output file for key.
+         */
+        std::string outputName( const std::string& key ) const;
+
     private:
         const std::string& ifname_;
         const std::string& odname_;
@@ -231,9 +482,47 @@ class BlockHandler {
         const std::string& header_;
         FileSplitter::LogPtr logger_;
         const std::vector<uint32_t>& keylist_;
+        const SplitConfig& config_;
+        InputSource::Ptr input_;                                ///> the view of the input used by the searches.
+        Transfer copier_;                                       ///> copies the key runs to their output files.
+        std::unique_ptr<UringOutput> uring_;                    ///> queues the outputs when io_uring is on.
+        Scheduler* scheduler_;                                  ///> the scheduler while running as a worker.
+        unsigned worker_;                                       ///> this worker's index in scheduler_.
+        Pipeline* pipeline_;                                    ///> where the runs go when the write workers are on.
+        BoundaryTable* boundaries_;                             ///> the boundaries shared with the other workers.
         std::string bkey_;
-        std::string ckey_;
-        char buf[BUFSIZE];                                      ///> one buffer per handler.
+        std::vector<scan::Span> fields_;                        ///> the key fields of the latest probe.
+        std::vector<long> probes_;                              ///> the probe offsets of a k-ary search round.
+
+        /**
+         * @brief A remembered probe: the key of the record starting at rsoff.
+         */
+        struct MemoEntry {
+            long rsoff;
+            std::string key;
+        };
+
+        std::vector<MemoEntry> memo_;                           ///> direct mapped on the record start; empty when off.
+        long memo_hits_;
+        long memo_misses_;
+        long predictions_;
+        long prediction_hits_;
+
+        /**
+         * @brief Get a view of the record that starts at rsoff, without its record delimiter.
+         *
+         * @param rsoff the byte offset of the start of a record.
+         * @param rec set to the first byte of the record.
+         * @return the length of the record in bytes, or -1 on error.
+         */
+        long recordView( long rsoff, const char*& rec );
+
+        /**
+         * @brief Copy a RUN or CHUNK task to its output file.
+         *
+         * @return true on success; false otherwise.
+         */
+        bool writeTask( const BlockTask& task );
 };
 
 #endif
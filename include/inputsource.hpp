@@ -0,0 +1,205 @@
+#pragma once
+
+#ifndef INPUTSOURCE_HPP
+#define INPUTSOURCE_HPP
+
+#include <atomic>
+#include <cstdio>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Search statistics summed over all of the block handlers of a run.
+ */
+struct ProbeStats {
+    std::atomic<long> hits{ 0 };                                ///> views served from the probe cache.
+    std::atomic<long> misses{ 0 };                              ///> cache blocks read with pread.
+    std::atomic<long> evictions{ 0 };                           ///> cache blocks dropped to make room.
+    std::atomic<long> memo_hits{ 0 };                           ///> probes answered from the (record start, key) memo.
+    std::atomic<long> memo_misses{ 0 };                         ///> probes that had to extract the key.
+    std::atomic<long> predictions{ 0 };                         ///> boundary searches started from a typed key model prediction.
+    std::atomic<long> prediction_hits{ 0 };                     ///> predictions whose two probes bracketed the boundary.
+};
+
+/**
+ * @brief A read-only, random access view of the file being split.
+ *
+ * The BlockHandler search helpers only ever need a run of contiguous bytes at some offset in the input.  An
+ * InputSource hands those bytes out as a const char* so the same search code works over a memory mapping or over a
+ * stdio buffer.
+ */
+class InputSource {
+    public:
+        using Ptr = std::unique_ptr<InputSource>;
+
+        /**
+         * @brief The backends that can be used to read the input file.
+         */
+        enum class Kind {
+            STDIO,                                              ///> fseek/fread into a private buffer.
+            MMAP,                                               ///> memory mapping of the file (or windows of it).
+            PREAD                                               ///> pread into a per-thread cache of page aligned blocks.
+        };
+
+        /**
+         * @brief Build an unopened InputSource.
+         *
+         * @param kind the backend to use.
+         * @param mapmax the largest number of bytes the MMAP backend will map at once; larger files use windows.
+         * @param cachemax the size in bytes of the PREAD backend's cache.
+         * @return the new source.
+         */
+        static Ptr create( Kind kind, long mapmax, long cachemax );
+
+        virtual ~InputSource( void );
+
+        /**
+         * @brief Open the file named fn for reading.
+         *
+         * @return true on success; false otherwise.
+         */
+        virtual bool open( const std::string& fn ) = 0;
+
+        /**
+         * @brief Release the file and any buffers or mappings.
+         */
+        virtual void close( void ) = 0;
+
+        /**
+         * @brief Get a pointer to the byte at offset off that is followed by at least min(len, size()-off) contiguous
+         * bytes of the file.
+         *
+         * The pointer is only valid until the next call to view or close.
+         *
+         * @param off the byte offset in the file; 0 <= off < size().
+         * @param len the number of contiguous bytes needed.
+         * @return the pointer or nullptr when off is out of bounds or the read failed.
+         */
+        virtual const char* view( long off, long len ) = 0;
+
+        /**
+         * @brief Tell the source that [off, off+len) is about to be read in order (e.g., to turn on read-ahead).
+         */
+        virtual void willScan( long off, long len );
+
+        /**
+         * @brief Start reading [off, off+len) in the background because a view of it will be asked for soon.
+         *
+         * Several of these can be in flight at once, so a search can overlap the latency of its next few probes.
+         */
+        virtual void willNeed( long off, long len );
+
+        /**
+         * @brief Add this source's counters to stats; only the PREAD backend counts anything.
+         */
+        virtual void addStats( ProbeStats& stats ) const;
+
+        /**
+         * @brief Get the size of the opened file in bytes.
+         */
+        long size( void ) const;
+
+    protected:
+        InputSource( void );
+
+        long size_;                                             ///> the size of the opened file.
+};
+
+/**
+ * @brief InputSource that reads through a FILE* into a private buffer.
+ *
+ * This works on anything fopen can read, but every view outside the current buffer costs a seek and a read.
+ */
+class StdioSource : public InputSource {
+    public:
+        StdioSource( void );
+        ~StdioSource( void );
+
+        bool open( const std::string& fn ) override;
+        void close( void ) override;
+        const char* view( long off, long len ) override;
+        void willNeed( long off, long len ) override;
+
+    private:
+        FILE* f_;
+        std::vector<char> buf_;
+        long boff_;                                             ///> file offset of buf_[0].
+        long blen_;                                             ///> number of valid bytes in buf_.
+};
+
+/**
+ * @brief InputSource over a read-only memory mapping of the file.
+ *
+ * Files up to mapmax bytes are mapped in one piece; larger files are mapped in page aligned windows of mapmax bytes
+ * that are moved whenever a view falls outside of the current one.
+ */
+class MappedSource : public InputSource {
+    public:
+        MappedSource( long mapmax );
+        ~MappedSource( void );
+
+        bool open( const std::string& fn ) override;
+        void close( void ) override;
+        const char* view( long off, long len ) override;
+        void willScan( long off, long len ) override;
+        void willNeed( long off, long len ) override;
+
+    private:
+        int fd_;
+        long mapmax_;                                           ///> the largest mapping we want to make.
+        long pagesize_;
+        char* base_;                                            ///> start of the current mapping.
+        long moff_;                                             ///> file offset of base_[0].
+        long mlen_;                                             ///> length of the current mapping.
+
+        bool remap( long off, long len );
+};
+
+/**
+ * @brief InputSource that reads through a small LRU cache of page aligned blocks filled with pread.
+ *
+ * Bisection probes tend to land on the same or neighboring pages as the probes before them; here those are served from
+ * memory without a seek or a system call.  A view that crosses blocks is copied into a scratch buffer.
+ */
+class CachedSource : public InputSource {
+    public:
+        static constexpr long BLOCK = 16 * 4096;                ///> cache block size (a multiple of the page size).
+
+        /**
+         * @param cachemax the cache size in bytes; at least two blocks are kept.
+         */
+        CachedSource( long cachemax );
+        ~CachedSource( void );
+
+        bool open( const std::string& fn ) override;
+        void close( void ) override;
+        const char* view( long off, long len ) override;
+        void willNeed( long off, long len ) override;
+        void addStats( ProbeStats& stats ) const override;
+
+    private:
+        /**
+         * @brief One cached block of the file.
+         */
+        struct Block {
+            long index;                                         ///> the block number: file offset / BLOCK.
+            long len;                                           ///> valid bytes (less than BLOCK at the end of the file).
+            std::vector<char> data;
+        };
+
+        int fd_;
+        size_t capacity_;                                       ///> the number of blocks kept.
+        std::list<Block> lru_;                                  ///> most recently used first.
+        std::unordered_map<long, std::list<Block>::iterator> blocks_;
+        std::vector<char> scratch_;                             ///> views that cross blocks.
+        long hits_;
+        long misses_;
+        long evictions_;
+
+        const Block* fetch( long index );
+};
+
+#endif
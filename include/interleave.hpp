@@ -0,0 +1,94 @@
+#pragma once
+
+#ifndef INTERLEAVE_HPP
+#define INTERLEAVE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "boundary.hpp"
+#include "spdlog/spdlog.h"
+
+/**
+ * @brief Resolves many block boundaries at once from one thread so the probe reads overlap.
+ *
+ * Each boundary search (the same bisection BlockHandler::resolveBoundary does) runs as a C++20 coroutine.  Every probe
+ * first tries a non-blocking read of the page cache (preadv2 with RWF_NOWAIT); on a miss the read is started in the
+ * background with posix_fadvise(WILLNEED) and the search suspends, so the thread moves on to the other searches in
+ * flight and resumes this one when the pages have arrived.  With cold caches or slow (e.g., network attached) storage the
+ * number of reads in flight, and so the throughput, follows the number of searches in flight instead of the number of
+ * threads.  A probe that misses RETRIES times in a row is read with a blocking pread.
+ *
+ * The engine is only built with the FILESPLITTER_COROUTINES build option (which needs a C++20 compiler); otherwise
+ * available returns false and the block handlers resolve the boundaries themselves.
+ */
+class InterleavedSearch {
+    public:
+        using LogPtr = std::shared_ptr<spdlog::logger>;
+
+        static constexpr long WINDOW = 16 * 1024;               ///> bytes read around a probe offset (grown as needed).
+        static constexpr int RETRIES = 256;                     ///> polls of a missed probe before a blocking read.
+
+        /**
+         * @brief Predicate indicating whether the coroutine engine was built.
+         */
+        static bool available( void );
+
+        /**
+         * @brief Construct an (unopened) engine.
+         *
+         * @param inflight the number of searches in flight at once.
+         * @param keylist the key fields (as in the block handlers).
+         * @param logger the logger.
+         */
+        InterleavedSearch( unsigned inflight, const std::vector<uint32_t>& keylist, LogPtr logger );
+        ~InterleavedSearch( void );
+
+        InterleavedSearch( const InterleavedSearch& ) = delete;
+        InterleavedSearch& operator=( const InterleavedSearch& ) = delete;
+
+        /**
+         * @brief Open the input file.
+         *
+         * @param ifname the input file.
+         * @param ifsize the size of the input file.
+         * @param hlen the length of the header; the first record starts there.
+         * @return true on success; false otherwise.
+         */
+        bool open( const std::string& ifname, long ifsize, long hlen );
+
+        /**
+         * @brief Close the input file.
+         */
+        void close( void );
+
+        /**
+         * @brief Resolve and publish every boundary of table in [first, last) that nobody else has claimed.
+         *
+         * @return the number of boundaries resolved, or -1 when the engine is not available.
+         */
+        long resolve( BoundaryTable& table, long first, long last );
+
+    private:
+        struct Probe;
+        struct Task;
+
+        unsigned inflight_;
+        const std::vector<uint32_t>& keylist_;
+        LogPtr logger_;
+        int fd_;
+        long ifsize_;
+        long hlen_;
+        bool nowait_;                                           ///> RWF_NOWAIT works on this file.
+        std::vector<Probe*> waiting_;                           ///> the probes whose searches are suspended.
+
+        long probes_;
+        long misses_;
+        long blocking_;
+
+        bool attempt( Probe& probe, bool block );
+        Task search( BoundaryTable& table, long i );
+};
+
+#endif
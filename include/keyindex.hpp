@@ -0,0 +1,105 @@
+#pragma once
+
+#ifndef KEYINDEX_HPP
+#define KEYINDEX_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "filesplitter.hpp"
+
+/**
+ * @brief A sparse index of the input's keys that is kept next to the input file and reused by later runs.
+ *
+ * The index holds the start and the key of the record found at every interval bytes of the input.  Because the keys
+ * of a sorted input form contiguous runs, the entries around a key bracket where its run starts and ends, so a search
+ * can begin on a range of about one interval instead of the whole block.
+ *
+ * The sidecar file is named after the input and the key fields (e.g., data.csv.1-5.fsidx) and records the input's
+ * size, modification time, inode and header length; it is only used when all of them still match.
+ */
+class KeyIndex {
+    public:
+        static constexpr long DEFAULT_INTERVAL = 256 * 1024;    ///> bytes of input per entry.
+
+        /**
+         * @brief The name of the sidecar index of ifname for the key fields keylist.
+         */
+        static std::string sidecarName( const std::string& ifname, const std::vector<uint32_t>& keylist );
+
+        KeyIndex( FileSplitter::LogPtr logger );
+
+        /**
+         * @brief Read the sidecar fn and check that it belongs to the current ifname, keylist and header length.
+         *
+         * @return true when the index was loaded and is valid; false otherwise (the index is then empty).
+         */
+        bool load( const std::string& fn, const std::string& ifname, const std::vector<uint32_t>& keylist, long hlen );
+
+        /**
+         * @brief Build the index by probing the record at every interval bytes of [begin, end).
+         *
+         * @param handler an open block handler whose key extractor reads the entries.
+         * @return true on success; false otherwise.
+         */
+        bool build( BlockHandler& handler, long begin, long end, long interval );
+
+        /**
+         * @brief Write the index to the sidecar fn along with the identity of ifname.
+         *
+         * @return true on success; false otherwise.
+         */
+        bool save( const std::string& fn, const std::string& ifname, const std::vector<uint32_t>& keylist, long hlen ) const;
+
+        /**
+         * @brief Narrow the search for the first record of key.
+         *
+         * @param key the key of the record at end.
+         * @param begin a position before the run of key (or the first record); moved forward to the last entry before
+         * the run.
+         * @param end the start of a record with key; moved back to the first entry in the run.
+         */
+        void narrowFirst( const std::string& key, long& begin, long& end ) const;
+
+        /**
+         * @brief Narrow the search for the end of the run of key that starts at soff.
+         *
+         * @param key the key of the run.
+         * @param soff the start of the run.
+         * @param from set to the last entry known to be in the run (or soff).
+         * @param end the end of the search; moved back to the first entry after the run.
+         */
+        void narrowNext( const std::string& key, long soff, long& from, long& end ) const;
+
+        /**
+         * @brief The number of entries.
+         */
+        std::size_t size( void ) const;
+
+        /**
+         * @brief The identity of an input file: if any of these change, offsets into it are no longer valid.
+         */
+        struct Identity {
+            int64_t size;
+            int64_t mtime_sec;
+            int64_t mtime_nsec;
+            int64_t inode;
+            int64_t device;
+            int64_t hlen;
+        };
+
+        /**
+         * @brief Get the identity of ifname with a header of hlen bytes.
+         *
+         * @return true on success; false if the file cannot be stat'ed.
+         */
+        static bool identity( const std::string& ifname, long hlen, Identity& id );
+
+    private:
+        FileSplitter::LogPtr logger_;
+        long interval_;
+        std::vector<long> offsets_;                             ///> record starts, increasing.
+        std::vector<std::string> keys_;
+};
+
+#endif
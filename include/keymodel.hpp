@@ -0,0 +1,103 @@
+#pragma once
+
+#ifndef KEYMODEL_HPP
+#define KEYMODEL_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "filesplitter.hpp"
+
+/**
+ * @brief A learned index over a typed key: predicts where the run of a key starts from a sample of the input.
+ *
+ * When the key is declared as an integer, a decimal or an ISO-8601 timestamp, every key is parsed into a fixed-width
+ * 64-bit value (decimals in millionths, timestamps in microseconds since the epoch).  The model is the piecewise-linear
+ * function through evenly spaced samples of (record start, value); the start of the run of a key is predicted by
+ * interpolating between the two samples whose values bracket it.
+ *
+ * The end of a run is predicted the same way, as the start of the run of the next value the keys can take (the
+ * greatest common divisor of the sampled value steps above the key).
+ *
+ * A prediction only chooses where the boundary search probes first (just before and just after the predicted offset).
+ * Every probe still narrows the interval by comparing keys, so a miss costs two probes and the search carries on with
+ * bisection (or galloping); the boundaries found are always the same as without the model.
+ */
+class KeyModel {
+    public:
+        static constexpr unsigned SAMPLES = 1024;               ///> evenly spaced samples in the model.
+
+        /**
+         * @brief The declared type of the key.
+         */
+        enum class Type {
+            STRING,                                             ///> no structure; bisection only.
+            INT,                                                ///> [+-]digits.
+            DECIMAL,                                            ///> [+-]digits[.digits]; 6 fraction digits are kept.
+            TIME                                                ///> YYYY-MM-DD[(T| )hh:mm[:ss[.ffffff]]][Z|(+|-)hh[:]mm]
+        };
+
+        /**
+         * @brief Convert a type name (as used on the command line) into a type.
+         *
+         * @param name one of string, int, decimal, time.
+         * @return true if the name was known; false otherwise.
+         */
+        static bool parse( const std::string& name, Type& type );
+
+        /**
+         * @brief Parse a key of the given type into its fixed-width value; blanks and double quotes around it are ignored.
+         *
+         * @return true on success; false if the key is not of that type.
+         */
+        static bool value( Type type, const char* p, std::size_t n, int64_t& v );
+
+        /**
+         * @brief Construct an empty model.
+         */
+        KeyModel( Type type, FileSplitter::LogPtr logger );
+
+        /**
+         * @brief Sample the input [begin, end) and build the model.
+         *
+         * The model stays empty (and predict always fails) when the keys cannot be parsed or the sampled values do not
+         * increase with the offset (e.g., the file is sorted as text and not as numbers).
+         *
+         * @param handler an open block handler whose key extractor reads the samples.
+         * @return true when the model can be used; false otherwise.
+         */
+        bool build( BlockHandler& handler, long begin, long end );
+
+        /**
+         * @brief Predict the start of the run of key.
+         *
+         * @param key the key (as joined by the block handlers).
+         * @param offset set to the predicted offset of its first record.
+         * @param error set to the model's typical error in bytes.
+         * @return true when there is a prediction; false otherwise.
+         */
+        bool predict( const std::string& key, long& offset, long& error ) const;
+
+        /**
+         * @brief Predict the end of the run of key: the start of the run of the next value above it.
+         *
+         * @param key the key (as joined by the block handlers).
+         * @param offset set to the predicted offset of the first record after the run.
+         * @param error set to the model's typical error in bytes.
+         * @return true when there is a prediction; false otherwise.
+         */
+        bool predictEnd( const std::string& key, long& offset, long& error ) const;
+
+    private:
+        Type type_;
+        FileSplitter::LogPtr logger_;
+        std::vector<long> offsets_;                             ///> sampled record starts, increasing.
+        std::vector<int64_t> values_;                           ///> their values, not decreasing.
+        long error_;
+        int64_t step_;                                          ///> the granularity of the values: gcd of the sampled steps.
+
+        long interpolate( std::size_t j, int64_t v ) const;
+        bool locate( int64_t v, long& offset, long& error ) const;
+};
+
+#endif
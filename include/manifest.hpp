@@ -0,0 +1,114 @@
+#pragma once
+
+#ifndef MANIFEST_HPP
+#define MANIFEST_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "keyindex.hpp"
+
+/**
+ * @brief The key manifest written by the plan command: where the run of every key is in the (unsplit) input.
+ *
+ * In plan mode the block handlers find the key runs exactly as they do for a split, but every run is added here
+ * instead of being copied, so the input is only probed.  The manifest can then be used to read any key's bytes straight
+ * out of the original file.
+ *
+ * The binary file is laid out so it can be used in place from a read-only mapping:
+ *
+ * - a FileHeader, including the identity of the input it describes,
+ * - count Entry records sorted by key (bytewise),
+ * - a string pool holding the input's header line followed by the keys.
+ *
+ * CSV and JSON views of the same entries can be written alongside it.
+ */
+class Manifest {
+    public:
+        static constexpr char MAGIC[8] = { 'F', 'S', 'M', 'A', 'N', 'I', 'F', '1' };
+
+        /**
+         * @brief The start of the manifest file.
+         */
+        struct FileHeader {
+            char magic[8];
+            uint32_t version;
+            uint32_t counted;                                   ///> 1 when the entries have record counts.
+            KeyIndex::Identity input;                           ///> the input the offsets are valid for.
+            uint64_t count;                                     ///> the number of entries.
+            uint64_t pool;                                      ///> file offset of the string pool.
+        };
+
+        /**
+         * @brief One key run.
+         */
+        struct Entry {
+            int64_t offset;                                     ///> the first byte of the run in the input.
+            int64_t length;                                     ///> the bytes in the run (whole records).
+            int64_t records;                                    ///> the records in the run, or -1 when not counted.
+            uint64_t key;                                       ///> offset of the key in the string pool.
+            uint32_t keylen;
+            uint32_t reserved;
+        };
+
+        /**
+         * @brief Construct an empty manifest.
+         *
+         * @param workers the number of threads that add runs (each adds to its own list).
+         */
+        Manifest( unsigned workers, FileSplitter::LogPtr logger );
+
+        /**
+         * @brief Add the key run [offset, offset+length) found by worker.
+         */
+        void add( unsigned worker, const std::string& key, long offset, long length );
+
+        /**
+         * @brief Merge the runs of all the workers; optionally count the records of each run.
+         *
+         * @param ifname the input file; it is only read when count is true.
+         * @param count true to count the records (this reads the whole input).
+         * @return true on success; false otherwise.
+         */
+        bool finish( const std::string& ifname, bool count );
+
+        /**
+         * @brief Write the binary manifest for the input ifname (whose header line is header) to fn.
+         *
+         * @return true on success; false otherwise.
+         */
+        bool write( const std::string& fn, const std::string& ifname, const std::string& header ) const;
+
+        /**
+         * @brief Write the runs as CSV (key,offset,length,records) to fn.
+         */
+        bool writeCSV( const std::string& fn ) const;
+
+        /**
+         * @brief Write the runs as a JSON array of objects to fn.
+         */
+        bool writeJSON( const std::string& fn ) const;
+
+        /**
+         * @brief The number of runs.
+         */
+        std::size_t size( void ) const;
+
+    private:
+        /**
+         * @brief A run before it is written.
+         */
+        struct Run {
+            std::string key;
+            long offset;
+            long length;
+            long records;
+        };
+
+        FileSplitter::LogPtr logger_;
+        std::vector<std::vector<Run>> lists_;                   ///> one list per worker.
+        std::vector<Run> runs_;                                 ///> the merged runs, sorted by key.
+        bool counted_;
+};
+
+#endif
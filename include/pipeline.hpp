@@ -0,0 +1,76 @@
+#pragma once
+
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <atomic>
+#include "scheduler.hpp"
+#include "spdlog/details/mpmc_bounded_q.h"
+
+/**
+ * @brief The hand off between the search workers and the write workers.
+ *
+ * When the pipeline is on, the search workers only find the key runs; every run (or chunk of a large run) they find is
+ * pushed as a RUN (or CHUNK) task into a bounded lock-free MPMC queue and a separate pool of write workers drains the
+ * queue and copies the bytes.  Searching is latency bound and copying is bandwidth bound, so the two pools are sized
+ * independently and neither stage waits for the other unless the queue is full or empty.
+ *
+ * A full queue makes the searchers wait (back pressure); an empty queue makes the writers wait until more work is pushed
+ * or finish is called.
+ */
+class Pipeline {
+    public:
+        static constexpr size_t DEPTH = 1024;                   ///> the queue size; must be a power of two.
+        static constexpr int SPINS = 64;                        ///> times to yield before sleeping on a full/empty queue.
+
+        /**
+         * @brief Construct a pipeline with an empty queue.
+         *
+         * @param writers the number of write workers that will drain it.
+         */
+        Pipeline( unsigned writers );
+
+        /**
+         * @brief The number of write workers.
+         */
+        unsigned writers( void ) const;
+
+        /**
+         * @brief Queue a RUN or CHUNK task for the write workers; waits while the queue is full.
+         */
+        void push( BlockTask task );
+
+        /**
+         * @brief Get the next task to write; waits while the queue is empty.
+         *
+         * @param task set to the next task.
+         * @return true when there is a task; false when the queue is empty and finish has been called.
+         */
+        bool next( BlockTask& task );
+
+        /**
+         * @brief Tell the write workers no more tasks will be pushed.
+         */
+        void finish( void );
+
+        /**
+         * @brief The number of times a search worker found the queue full (more writers may help).
+         */
+        long stalls( void ) const;
+
+        /**
+         * @brief The number of times a write worker found the queue empty (more searchers may help).
+         */
+        long starves( void ) const;
+
+    private:
+        spdlog::details::mpmc_bounded_queue<BlockTask> queue_;
+        unsigned writers_;
+        std::atomic<bool> finished_;
+        std::atomic<long> stalls_;
+        std::atomic<long> starves_;
+
+        static void backoff( int& spins );
+};
+
+#endif
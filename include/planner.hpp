@@ -0,0 +1,100 @@
+#pragma once
+
+#ifndef PLANNER_HPP
+#define PLANNER_HPP
+
+#include <string>
+#include <vector>
+#include "filesplitter.hpp"
+
+/**
+ * @brief Chooses the search strategy for each block from a random sample of the input's keys.
+ *
+ * Every sample is a random offset whose record (start, length and key) is read with the block handler's key extractor,
+ * along with the key of the record that follows it.  From the samples in a region the planner estimates:
+ *
+ * - the average record length R,
+ * - the average key run length L: from how often a record is followed by one with the same key when runs are short,
+ *   or from how often neighboring samples have different keys when runs are longer than the sample spacing,
+ * - the number of key runs in the region K = region bytes / L.
+ *
+ * and picks the cheapest strategy, counting costs in random probes:
+ *
+ * - BISECT: K * log2(region records), each run is bisected over what is left of the block.
+ * - GALLOP: K * 2 * log2(L / R + 2), each run is galloped then bisected.
+ * - STREAM: region bytes / STREAM_BYTES + region records / KEYS_PER_PROBE, every record is read in order.
+ */
+class Planner {
+    public:
+        static constexpr double STREAM_BYTES = 64.0 * 1024;    ///> sequential bytes read for the cost of one random probe.
+        static constexpr double KEYS_PER_PROBE = 64.0;          ///> key extractions for the cost of one random probe.
+
+        /**
+         * @brief The estimates for a region of the input.
+         */
+        struct Estimate {
+            long samples;                                       ///> samples that fell in the region.
+            double record_bytes;                                ///> R
+            double run_bytes;                                   ///> L
+            double runs;                                        ///> K
+            double bisect;                                      ///> estimated probes for each strategy.
+            double gallop;
+            double stream;
+            SearchStrategy choice;
+        };
+
+        /**
+         * @brief Construct a planner.
+         *
+         * @param handler the (open) block handler whose key extractor is used for the samples.
+         * @param begin the first byte of the data (just past the header).
+         * @param end the size of the input.
+         * @param logger the logger the estimates and decisions are written to.
+         */
+        Planner( BlockHandler& handler, long begin, long end, FileSplitter::LogPtr logger );
+
+        /**
+         * @brief Sample n random offsets of the input.
+         *
+         * @return true on success; false if a record could not be read.
+         */
+        bool sample( unsigned n );
+
+        /**
+         * @brief Estimate the costs for the region [begin, end) and pick a strategy.
+         *
+         * Regions with fewer than two samples use the estimates for the whole input.
+         */
+        Estimate estimate( long begin, long end ) const;
+
+        /**
+         * @brief Pick the search strategy for the region [begin, end).
+         */
+        SearchStrategy choose( long begin, long end ) const;
+
+        /**
+         * @brief Name of a strategy for logging.
+         */
+        static const char* name( SearchStrategy search );
+
+    private:
+        /**
+         * @brief One sampled record.
+         */
+        struct Sample {
+            long offset;                                        ///> start of the record.
+            long length;                                        ///> length including the record delimiter.
+            std::string key;
+            bool same_next;                                     ///> the next record has the same key.
+        };
+
+        BlockHandler& handler_;
+        long begin_;
+        long end_;
+        FileSplitter::LogPtr logger_;
+        std::vector<Sample> samples_;                           ///> sorted by offset.
+
+        Estimate estimate( std::vector<Sample>::const_iterator first, std::vector<Sample>::const_iterator last, long begin, long end ) const;
+};
+
+#endif
@@ -0,0 +1,96 @@
+#pragma once
+
+#ifndef SCAN_HPP
+#define SCAN_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Byte scanning primitives used by the record and key searches.
+ *
+ * On x86 the vector (AVX2 or SSE2) version of each primitive is selected once, at run time, based on what the CPU
+ * supports; everywhere else a scalar version is used.
+ */
+namespace scan {
+
+/**
+ * @brief Find the last occurrence of c in the n bytes starting at p (a vectorized memrchr).
+ *
+ * @param p the first byte to search.
+ * @param n the number of bytes to search.
+ * @param c the byte to look for.
+ * @return a pointer to the last occurrence of c or nullptr if c is not in [p, p+n).
+ */
+const char* findLast( const char* p, std::size_t n, char c );
+
+/**
+ * @brief Find the k-th occurrence (1-based) of c in the n bytes starting at p.
+ *
+ * The vector versions build a bitmask of the matches in 64 (AVX2) or 16 (SSE2) bytes at a time, skip whole blocks by
+ * their popcount and pick the match within the final block with tzcnt.
+ *
+ * @param p the first byte to search.
+ * @param n the number of bytes to search.
+ * @param c the byte to look for.
+ * @param k which occurrence to find; k >= 1.
+ * @return a pointer to the k-th occurrence of c or nullptr if there are fewer than k in [p, p+n).
+ */
+const char* findNth( const char* p, std::size_t n, char c, std::size_t k );
+
+/**
+ * @brief A run of bytes inside a buffer owned by someone else; nothing is copied.
+ */
+struct Span {
+    const char* data;
+    std::size_t size;
+};
+
+/**
+ * @brief Locate the key fields of a record without copying any characters.
+ *
+ * One span is produced for the first index in indices and for every index the field walk advances to; the key of the
+ * record is the join of the spans with '.'.  When a record has fewer fields than an index asks for, the walk stops
+ * early (so a key of 1,5 on a record with 3 fields is "a.").  An index that is not larger than the one before it
+ * gives an empty span.
+ *
+ * @param rec the first byte of the record.
+ * @param len the length of the record, without its record delimiter.
+ * @param fdelim the field delimiter.
+ * @param indices the 1-based field indices that make up the key, sorted smallest to largest.
+ * @param spans set to the key fields (this is modified by the function).
+ */
+void fields( const char* rec, std::size_t len, char fdelim, const std::vector<uint32_t>& indices, std::vector<Span>& spans );
+
+/**
+ * @brief Build the key string from spans found by fields.
+ *
+ * @param spans the key fields.
+ * @param sep the character placed between the fields.
+ * @param key set to the joined fields (this is modified by the function).
+ */
+void join( const std::vector<Span>& spans, char sep, std::string& key );
+
+/**
+ * @brief Predicate indicating whether the spans joined with sep are equal to key; nothing is copied.
+ */
+bool equals( const std::vector<Span>& spans, char sep, const std::string& key );
+
+/**
+ * @brief A fast, non-cryptographic 64-bit hash of the n bytes starting at p.
+ *
+ * The bytes are mixed eight at a time with multiplies (in the style of MurmurHash64A), so a short key costs a few
+ * cycles.  The value is the same on every run and machine of the same endianness.
+ */
+uint64_t hash( const char* p, std::size_t n );
+
+/**
+ * @brief The name of the instruction set used by the scanning primitives, e.g., for logging.
+ */
+const char* implementation( void );
+
+}  // end namespace.
+
+#endif
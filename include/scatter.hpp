@@ -0,0 +1,142 @@
+#pragma once
+
+#ifndef SCATTER_HPP
+#define SCATTER_HPP
+
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "filesplitter.hpp"
+
+/**
+ * @brief Output descriptors shared by the scatter workers, kept under the process's open file limit.
+ *
+ * At most capacity descriptors are open at once; when another is needed the least recently used one that no worker is
+ * writing to is closed, and reopened for appending when its key comes up again.  The first open of a key in a run
+ * truncates the file and writes the header, so every output has the header exactly once.  A key is used by one worker
+ * at a time, so the batches written to it never interleave.
+ */
+class DescriptorPool {
+    public:
+        static constexpr long RESERVE = 64;                     ///> descriptors left for the input, the logs, etc.
+
+        /**
+         * @brief Construct a pool that may use up to capacity descriptors.
+         */
+        DescriptorPool( const std::string& odname, const std::string& header, long capacity, FileSplitter::LogPtr logger );
+        ~DescriptorPool( void );
+
+        /**
+         * @brief The largest capacity the open file limit (RLIMIT_NOFILE) allows; the soft limit is raised to the hard
+         * limit first.
+         */
+        static long limit( void );
+
+        /**
+         * @brief Get the output of key for writing; waits while another worker writes to it.
+         *
+         * @return the descriptor (opened for appending), or -1 on error; every acquire must be followed by release.
+         */
+        int acquire( const std::string& key );
+
+        /**
+         * @brief Let other workers use the output of key; it stays open until it is the least recently used.
+         */
+        void release( const std::string& key );
+
+        /**
+         * @brief Close every open descriptor.
+         *
+         * @return true when they all closed cleanly; false otherwise.
+         */
+        bool close( void );
+
+        long opens( void ) const;
+        long evictions( void ) const;
+
+    private:
+        /**
+         * @brief The state of one key's output.
+         */
+        struct Output {
+            int fd;                                             ///> -1 while closed.
+            bool busy;                                          ///> a worker is writing to it.
+            std::list<std::string>::iterator lru;               ///> its place in lru_ while open.
+        };
+
+        std::string odname_;
+        const std::string& header_;
+        long capacity_;
+        FileSplitter::LogPtr logger_;
+
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::unordered_map<std::string, Output> outputs_;       ///> every key seen in this run.
+        std::list<std::string> lru_;                            ///> the open outputs, most recently used first.
+        long open_;
+        long opens_;
+        long evictions_;
+        bool failed_;
+
+        bool evict( void );
+};
+
+/**
+ * @brief Splits an input that is not sorted by key: every key still ends up in exactly one file.
+ *
+ * The input is cut into one byte range per thread (moved to record starts).  Each worker reads its range in large
+ * sequential reads and appends every record to a private buffer for its key; a key's buffer is written out when it
+ * grows past KEYFLUSH bytes, and all of the buffers are written out when the worker holds FLUSH bytes, so the outputs
+ * get a few large writes instead of one per record.  The outputs are shared by all of the workers through a
+ * DescriptorPool.
+ *
+ * The records of a key keep their input order within each batch, but the batches of different workers are appended in
+ * the order they are written.
+ *
+ * With partitions the outputs are N buckets (part-00000.csv, ...) instead of one file per key: a record goes to the
+ * bucket its key hashes to (scan::hash), so every key is in exactly one bucket and the buckets are about the same size
+ * when there are many more keys than buckets.
+ */
+class Scatter {
+    public:
+        static constexpr long READSIZE = 4 * 1024 * 1024;       ///> bytes per read of the input.
+        static constexpr long KEYFLUSH = 256 * 1024;            ///> a key's buffer is written at this size.
+        static constexpr long FLUSH = 64 * 1024 * 1024;         ///> all of a worker's buffers are written at this total.
+
+        /**
+         * @brief Construct a scatter.
+         *
+         * @param partitions the number of hash buckets; 0 writes one file per key.
+         */
+        Scatter( const std::string& ifname, long ifsize, const std::string& header, DescriptorPool& pool, const std::vector<uint32_t>& keylist, unsigned partitions, FileSplitter::LogPtr logger );
+
+        /**
+         * @brief The output name (without .csv) of bucket i.
+         */
+        static std::string partName( unsigned i );
+
+        /**
+         * @brief Scatter the records of the input with threads workers.
+         *
+         * @return true on success; false on a read or write error.
+         */
+        bool run( unsigned threads );
+
+    private:
+        std::string ifname_;
+        long ifsize_;
+        long hlen_;
+        DescriptorPool& pool_;
+        const std::vector<uint32_t>& keylist_;
+        unsigned partitions_;
+        std::vector<std::string> names_;                        ///> the bucket output names.
+        FileSplitter::LogPtr logger_;
+
+        bool scatter( long begin, long end, long& records );
+        bool flush( const std::string& key, std::string& buf );
+};
+
+#endif
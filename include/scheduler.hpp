@@ -0,0 +1,117 @@
+#pragma once
+
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief How a block handler enumerates the key runs inside its block.
+ */
+enum class SearchStrategy {
+    BISECT,                                                     ///> walk backward from the end; bisect the whole block per key.
+    GALLOP,                                                     ///> walk forward; gallop from each run start, then bisect.
+    STREAM,                                                     ///> walk forward reading every record.
+    AUTO                                                        ///> let the planner pick one of the above per block.
+};
+
+/**
+ * @brief A unit of work for a block handler.
+ */
+struct BlockTask {
+    /**
+     * @brief The kinds of work.
+     */
+    enum class Kind {
+        BLOCK,                                                  ///> find the key runs that start in [begin, end) and write them.
+        RUN,                                                    ///> write the key run [begin, end) to the output for key.
+        CHUNK                                                   ///> copy [begin, end) into the existing output for key at ooff.
+    };
+
+    Kind kind;
+    long begin;
+    long end;
+    std::string key;                                            ///> RUN and CHUNK only.
+    long ooff;                                                  ///> CHUNK only.
+    SearchStrategy search;                                      ///> BLOCK only.
+};
+
+/**
+ * @brief Work-stealing scheduler for the block handler threads.
+ *
+ * Every worker has its own deque of tasks.  A worker takes its next task from the back of its own deque; when that is
+ * empty it steals from the front of another worker's deque, so thieves take the work farthest from where the owner is
+ * working.  Workers that find nothing to steal sleep until more work is pushed or everything is done.
+ *
+ * A worker may push new tasks while it runs one (e.g., a key run it wants to hand off), so the scheduler is only
+ * finished when every pushed task has been completed.
+ */
+class Scheduler {
+    public:
+        /**
+         * @brief Construct a scheduler.
+         *
+         * @param workers the number of worker deques (and threads).
+         */
+        Scheduler( unsigned workers );
+
+        /**
+         * @brief The number of workers.
+         */
+        unsigned workers( void ) const;
+
+        /**
+         * @brief Push task onto the back of the deque of worker.
+         */
+        void push( unsigned worker, BlockTask task );
+
+        /**
+         * @brief Get the next task for worker, stealing if necessary; blocks while other workers may still push.
+         *
+         * @param worker the worker asking.
+         * @param task set to the next task.
+         * @return true when there is a task; false when all of the work is done.
+         */
+        bool next( unsigned worker, BlockTask& task );
+
+        /**
+         * @brief Tell the scheduler a task returned by next has been completed.
+         */
+        void done( void );
+
+        /**
+         * @brief Predicate indicating whether some worker is waiting for work (so handing work off is worthwhile).
+         */
+        bool hungry( void ) const;
+
+        /**
+         * @brief The number of tasks that were stolen.
+         */
+        long steals( void ) const;
+
+    private:
+        /**
+         * @brief One worker's deque.
+         */
+        struct Queue {
+            std::mutex mutex;
+            std::deque<BlockTask> tasks;
+        };
+
+        std::vector<std::unique_ptr<Queue>> queues_;
+        std::atomic<long> pending_;                             ///> tasks pushed and not yet done.
+        std::atomic<unsigned> idle_;                            ///> workers waiting for work.
+        std::atomic<long> steals_;
+        std::mutex mutex_;                                      ///> protects the sleep/wake up.
+        std::condition_variable wake_;
+
+        bool take( unsigned worker, BlockTask& task );
+};
+
+#endif
@@ -0,0 +1,118 @@
+#pragma once
+
+#ifndef SLICEREADER_HPP
+#define SLICEREADER_HPP
+
+#include <cstddef>
+#include <string>
+#include "manifest.hpp"
+
+/**
+ * @brief Read-only access to the key runs of a file through its manifest, without splitting it.
+ *
+ * The reader maps the manifest written by the plan command and the original input, and hands out pointers straight
+ * into the input's mapping: the bytes of a key's records are never copied and no split files are written.  A key is
+ * found with a binary search of the manifest's sorted entries (a few memcmp calls even for millions of keys); an entry
+ * number gives its slice in constant time.
+ *
+ * The manifest is only used when the input still has the size, modification time, inode and header length it had
+ * when the manifest was written.
+ */
+class KeySliceReader {
+    public:
+        /**
+         * @brief A run of contiguous bytes in one of the mappings; valid until the reader is closed.
+         */
+        struct Slice {
+            const char* data;
+            std::size_t size;
+
+            bool empty( void ) const { return size == 0; }
+            std::string str( void ) const { return std::string{ data, size }; }
+        };
+
+        static constexpr std::size_t NPOS = static_cast<std::size_t>( -1 );
+
+        KeySliceReader( FileSplitter::LogPtr logger );
+        ~KeySliceReader( void );
+
+        KeySliceReader( const KeySliceReader& ) = delete;
+        KeySliceReader& operator=( const KeySliceReader& ) = delete;
+
+        /**
+         * @brief Map the manifest mfn and the input file ifname it was written for.
+         *
+         * @return true on success; false if either cannot be mapped or the manifest does not match the input.
+         */
+        bool open( const std::string& mfn, const std::string& ifname );
+
+        /**
+         * @brief Unmap both files.
+         */
+        void close( void );
+
+        /**
+         * @brief The number of keys (entries) in the manifest.
+         */
+        std::size_t size( void ) const;
+
+        /**
+         * @brief The input's header line including its delimiter; empty when there is no header.
+         */
+        Slice header( void ) const;
+
+        /**
+         * @brief The entry number of key, or NPOS when the key is not in the input.
+         */
+        std::size_t find( const std::string& key ) const;
+
+        /**
+         * @brief The entry number of the first key that is not less than key (bytewise); size() when there is none.
+         */
+        std::size_t lowerBound( const std::string& key ) const;
+
+        /**
+         * @brief The key of entry i.
+         */
+        Slice key( std::size_t i ) const;
+
+        /**
+         * @brief The records of entry i: whole records, in input order, ending with a record delimiter unless the run
+         * ends the input.
+         */
+        Slice records( std::size_t i ) const;
+
+        /**
+         * @brief The records of key; an empty slice when the key is not in the input.
+         */
+        Slice records( const std::string& key ) const;
+
+        /**
+         * @brief The number of records of entry i, or -1 when the manifest was written without counts.
+         */
+        long count( std::size_t i ) const;
+
+        /**
+         * @brief The manifest entry i (input offset and length of its run).
+         */
+        const Manifest::Entry& entry( std::size_t i ) const;
+
+        /**
+         * @brief Ask the kernel to start reading the records of entry i in the background.
+         */
+        void willNeed( std::size_t i ) const;
+
+    private:
+        FileSplitter::LogPtr logger_;
+        const char* mbase_;                                     ///> the manifest mapping.
+        std::size_t mlen_;
+        const char* ibase_;                                     ///> the input mapping.
+        std::size_t ilen_;
+        const Manifest::FileHeader* fh_;
+        const Manifest::Entry* entries_;
+        const char* pool_;
+
+        int compare( std::size_t i, const std::string& key ) const;
+};
+
+#endif
@@ -0,0 +1,135 @@
+#pragma once
+
+#ifndef STREAM_HPP
+#define STREAM_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "filesplitter.hpp"
+#include "spdlog/details/mpmc_bounded_q.h"
+
+/**
+ * @brief Splits a sorted input that can only be read once, from start to end (stdin, a FIFO, a pipe from a
+ * decompressor), in a single pass.
+ *
+ * Three stages run at once:
+ *
+ * 1. a reader thread fills large buffers from the input and cuts each one after its last record delimiter; the partial
+ *    record at the end is carried to the front of the next buffer, so every buffer holds whole records,
+ * 2. the calling thread scans the records of each buffer in order and, whenever the key changes, hands the bytes of
+ *    the finished key run (or the part of a long run in this buffer) to a writer,
+ * 3. writer threads append the pieces to the key's output file.
+ *
+ * The pieces point into the buffers, so the data is never copied between the stages; a buffer goes back to the
+ * reader's pool once every piece in it is written.  All of the pieces of one key go to the same writer in order, so
+ * the writers never coordinate.  The pool and the writer queues are bounded: a slow writer eventually stops the reader.
+ * A writer with nothing to do spins briefly and then blocks until the scanner hands it a piece, so an idle pipe costs
+ * no CPU.
+ */
+class StreamSplitter {
+    public:
+        static constexpr long BUFSIZE = 4 * 1024 * 1024;        ///> the size of the read buffers.
+        static constexpr size_t DEPTH = 256;                    ///> the size of each writer's queue; a power of two.
+        static constexpr int SPINS = 64;                        ///> times to yield before sleeping on a full queue or blocking on an empty one.
+        static constexpr unsigned SPARE = 4;                    ///> buffers in the pool beyond one per writer.
+
+        /**
+         * @brief Construct a splitter.
+         *
+         * @param odname the output directory (ending in '/').
+         * @param header true when the first record of the input is a header line.
+         * @param keylist the key fields.
+         * @param writers the number of writer threads.
+         */
+        StreamSplitter( const std::string& odname, bool header, const std::vector<uint32_t>& keylist, unsigned writers, FileSplitter::LogPtr logger );
+
+        /**
+         * @brief Split the input read from the descriptor fd until its end.
+         *
+         * @return true on success; false on a read or write error.
+         */
+        bool split( int fd );
+
+    private:
+        /**
+         * @brief One read buffer; data holds len bytes of whole records.
+         */
+        struct Buffer {
+            std::vector<char> data;
+            std::size_t len;
+        };
+
+        using BufferPtr = std::shared_ptr<const Buffer>;
+
+        /**
+         * @brief The bytes [off, off+len) of buf that belong to the run of key.
+         */
+        struct Piece {
+            BufferPtr buf;
+            std::size_t off;
+            std::size_t len;
+            std::string key;
+            bool first;                                         ///> the first piece of the run: create the output.
+        };
+
+        using Queue = spdlog::details::mpmc_bounded_queue<Piece>;
+
+        /**
+         * @brief Where a writer blocks while its queue is empty.
+         */
+        struct Waiter {
+            std::mutex mutex;
+            std::condition_variable cv;
+            bool sleeping;                                      ///> the writer is blocked on cv; guarded by mutex.
+            bool woken;                                         ///> guarded by mutex.
+        };
+
+        /**
+         * @brief What the scanner knows about the run that is still open at the end of a buffer.
+         */
+        struct ScanState {
+            std::string key;
+            bool started;                                       ///> a run has been seen.
+            bool first;                                         ///> no piece of the run has been pushed yet.
+            bool header;                                        ///> the next record is the header line.
+        };
+
+        std::string odname_;
+        bool has_header_;
+        std::string header_;                                    ///> set by the scanner before the first piece.
+        const std::vector<uint32_t>& keylist_;
+        unsigned writers_;
+        FileSplitter::LogPtr logger_;
+
+        std::vector<std::unique_ptr<Queue>> queues_;            ///> one per writer.
+        std::vector<std::unique_ptr<Waiter>> waiters_;          ///> one per writer.
+        std::atomic<bool> finished_;
+        std::atomic<bool> failed_;
+
+        std::mutex mutex_;                                      ///> guards the pool and the filled buffers.
+        std::condition_variable cv_;
+        std::vector<std::unique_ptr<Buffer>> pool_;             ///> empty buffers for the reader.
+        std::deque<std::unique_ptr<Buffer>> filled_;            ///> buffers waiting for the scanner.
+        bool eof_;
+
+        std::atomic<long> runs_;
+        std::atomic<long> stalls_;
+
+        void read( int fd );
+        void scan( BufferPtr buf, ScanState& state );
+        void write( unsigned w );
+        void push( unsigned w, Piece&& piece );
+        bool wait( unsigned w, Piece& piece );
+        void wake( unsigned w );
+        BufferPtr share( std::unique_ptr<Buffer> buf );
+        void release( Buffer* buf );
+
+        static void backoff( int& spins );
+};
+
+#endif
@@ -0,0 +1,150 @@
+#pragma once
+
+#ifndef TRANSFER_HPP
+#define TRANSFER_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "spdlog/spdlog.h"
+
+/**
+ * @brief Copies byte ranges of the input file into output files.
+ *
+ * One engine is used per thread; it keeps a single descriptor open on the input for all of the copies the thread
+ * makes.  The copy itself is done by the kernel whenever possible so the bytes never pass through user space:
+ *
+ * 1. copy_file_range (can share extents or copy inside the page cache),
+ * 2. sendfile,
+ * 3. splice through a pipe,
+ * 4. pread/pwrite through a private buffer (always works).
+ *
+ * When a method is not supported for a pair of files the engine falls back to the next one and stays there.
+ */
+class Transfer {
+    public:
+        using LogPtr = std::shared_ptr<spdlog::logger>;
+
+        static constexpr int BUFSIZE = 64 * 1024;               ///> buffer size for the pread/pwrite method.
+
+        /**
+         * @brief The copy methods in the order they are tried.
+         */
+        enum class Method {
+            COPY_FILE_RANGE,
+            SENDFILE,
+            SPLICE,
+            READWRITE
+        };
+
+        /**
+         * @brief Convert a method name (as used on the command line) into a method.
+         *
+         * @param name one of auto, copy_file_range, sendfile, splice, readwrite; auto is copy_file_range.
+         * @param method set to the method.
+         * @return true if the name was known; false otherwise.
+         */
+        static bool parse( const std::string& name, Method& method );
+
+        /**
+         * @brief The name of a method.
+         */
+        static const char* name( Method method );
+
+        /**
+         * @brief Construct an engine.
+         *
+         * @param method the first method to try.
+         * @param logger the logger used to report fall backs.
+         */
+        Transfer( Method method, LogPtr logger );
+        Transfer( Transfer&& other );
+        ~Transfer( void );
+
+        /**
+         * @brief Open the input file the copies are made from.
+         *
+         * @return true on success; false otherwise.
+         */
+        bool open( const std::string& ifname );
+
+        /**
+         * @brief Close the input file.
+         */
+        void close( void );
+
+        /**
+         * @brief Create (or truncate) the file ofn and fill it with header followed by the input bytes [soff, soff+len).
+         *
+         * @return the number of input bytes written (the header is not counted), or -1 on error.
+         */
+        long toFile( const std::string& ofn, const std::string& header, long soff, long len );
+
+        /**
+         * @brief Create (or truncate) the file ofn, write header at its start and preallocate room for len more bytes.
+         *
+         * The data is then filled in, possibly by several threads at once, with toFileAt.
+         *
+         * @return true on success; false otherwise.
+         */
+        bool prepare( const std::string& ofn, const std::string& header, long len );
+
+        /**
+         * @brief Copy the input bytes [soff, soff+len) into the existing file ofn at the output offset ooff.
+         *
+         * @return the number of input bytes written, or -1 on error.
+         */
+        long toFileAt( const std::string& ofn, long ooff, long soff, long len );
+
+        /**
+         * @brief Copy the input bytes [soff, soff+len) to the descriptor ofd at the output offset ooff.
+         *
+         * The descriptor's file position is not used, so several threads can write different parts of one file.
+         *
+         * @return the number of bytes copied; less than len when the input ends early, or -1 on error.
+         */
+        long copy( int ofd, long ooff, long soff, long len );
+
+        /**
+         * @brief Copy the input bytes [soff, soff+len) to the current position of the descriptor ofd.
+         *
+         * Unlike copy, this works on pipes, sockets and terminals: it uses sendfile and falls back to read/write.
+         *
+         * @return the number of bytes copied; less than len when the input ends early, or -1 on error.
+         */
+        long stream( int ofd, long soff, long len );
+
+        /**
+         * @brief Write all of the bytes in [p, p+len) to the descriptor ofd at its current position.
+         *
+         * @return true on success; false otherwise.
+         */
+        static bool writeAll( int ofd, const char* p, long len );
+
+        /**
+         * @brief Write all of the bytes in [p, p+len) to the descriptor ofd at the output offset ooff.
+         *
+         * @return true on success; false otherwise.
+         */
+        static bool writeAt( int ofd, long ooff, const char* p, long len );
+
+        /**
+         * @brief The method that is currently used.
+         */
+        Method method( void ) const;
+
+    private:
+        Method method_;
+        LogPtr logger_;
+        int ifd_;                                               ///> the input descriptor (one per thread).
+        int pipe_[2];                                           ///> the pipe used by the splice method.
+        std::vector<char> buf_;                                 ///> the buffer used by the pread/pwrite method.
+
+        long copyChunk( int ofd, long ooff, long soff, long len );
+        long spliceChunk( int ofd, long ooff, long soff, long len );
+        long readWriteChunk( int ofd, long ooff, long soff, long len );
+        bool fallback( int err );
+        void closePipe( void );
+};
+
+#endif
@@ -0,0 +1,126 @@
+#pragma once
+
+#ifndef URING_HPP
+#define URING_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/uio.h>
+#include "transfer.hpp"
+
+/**
+ * @brief Writes key outputs through io_uring so that many small output files are in flight at once.
+ *
+ * Every output is submitted as one linked chain of three operations:
+ *
+ * 1. openat into a registered (direct) descriptor slot,
+ * 2. writev of the header and the key's bytes, taken straight from a read-only mapping of the input,
+ * 3. close of the slot.
+ *
+ * Up to depth chains are in flight per thread; submit only blocks when all of them are.  Outputs larger than
+ * MAXBYTES, and outputs whose chain fails, are written synchronously by the thread's Transfer engine instead.
+ *
+ * The ring is driven through the raw io_uring syscalls, so liburing is not needed.  When the build or the kernel does
+ * not support io_uring, open fails and the caller keeps using its Transfer engine.
+ */
+class UringOutput {
+    public:
+        static constexpr long MAXBYTES = 64L * 1024 * 1024;     ///> larger outputs are left to the kernel copy methods.
+
+        /**
+         * @brief Construct an (unopened) output engine.
+         *
+         * @param depth the number of outputs that may be in flight at once.
+         * @param fallback the engine used for large or failed outputs; it must already be open.
+         * @param logger the logger.
+         */
+        UringOutput( unsigned depth, Transfer& fallback, Transfer::LogPtr logger );
+        ~UringOutput( void );
+
+        UringOutput( const UringOutput& ) = delete;
+        UringOutput& operator=( const UringOutput& ) = delete;
+
+        /**
+         * @brief Set up the ring and map the input file.
+         *
+         * @param ifname the input file.
+         * @param ifsize the size of the input file.
+         * @return true on success; false when io_uring (or one of the operations) is not available.
+         */
+        bool open( const std::string& ifname, long ifsize );
+
+        /**
+         * @brief Queue the output file ofn: header followed by the input bytes [soff, soff+len).
+         *
+         * @param header the header; it must stay valid until drain returns.
+         * @return the number of input bytes queued or written, or -1 on error.
+         */
+        long submit( const std::string& ofn, const std::string& header, long soff, long len );
+
+        /**
+         * @brief Wait until every queued output has been written.
+         *
+         * @return the number of outputs that had to be rewritten synchronously or failed.
+         */
+        long drain( void );
+
+        /**
+         * @brief Tear down the ring and the mapping; in flight outputs are drained first.
+         */
+        void close( void );
+
+    private:
+        /**
+         * @brief The state of one in flight output; its index is also its direct descriptor slot.
+         */
+        struct Slot {
+            bool busy;
+            bool failed;
+            int pending;                                        ///> completions still expected.
+            long soff;
+            long len;
+            std::string ofn;
+            const std::string* header;
+            struct iovec iov[2];
+        };
+
+        unsigned depth_;
+        Transfer& fallback_;
+        Transfer::LogPtr logger_;
+        int ring_;                                              ///> the io_uring descriptor.
+        unsigned sqentries_;
+        unsigned cqentries_;
+
+        void* sqmap_;
+        size_t sqmaplen_;
+        void* cqmap_;
+        size_t cqmaplen_;
+        void* sqemap_;
+        size_t sqemaplen_;
+
+        unsigned* sqhead_;
+        unsigned* sqtail_;
+        unsigned* sqmask_;
+        unsigned* sqarray_;
+        unsigned* cqhead_;
+        unsigned* cqtail_;
+        unsigned* cqmask_;
+        void* cqes_;
+        void* sqes_;
+
+        const char* base_;                                      ///> the read-only mapping of the input.
+        long ifsize_;
+
+        std::vector<Slot> slots_;
+        unsigned inflight_;
+        long redone_;
+
+        bool supported( void );
+        void* nextSqe( void );
+        bool enter( unsigned min_complete );
+        bool reap( unsigned min_complete );
+        void finish( Slot& slot );
+};
+
+#endif
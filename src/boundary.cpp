@@ -0,0 +1,94 @@
+#include "boundary.hpp"
+
+#include <thread>
+
+BoundaryTable::BoundaryTable( long first, long size, long nblocks, long block_size ) :
+    first_{ first },
+    size_{ size },
+    count_{ nblocks + 1 },
+    block_size_{ block_size > 0 ? block_size : 1 },
+    entries_{ new Entry[ nblocks + 1 ] },
+    searches_{ 0 },
+    shortcuts_{ 0 },
+    waits_{ 0 }
+{
+    for ( long i = 0; i < count_; ++i ) {
+        entries_[i].offset.store( UNRESOLVED, std::memory_order_relaxed );
+    }
+
+    // the end of the file is always a boundary.
+    entries_[ count_ - 1 ].offset.store( size_, std::memory_order_release );
+}
+
+long BoundaryTable::index( long offset ) const
+{
+    if ( offset < first_ || (offset - first_) % block_size_ != 0 ) return -1;
+
+    long i = (offset - first_) / block_size_;
+    return ( i < count_ ) ? i : -1;
+}
+
+long BoundaryTable::proposed( long i ) const
+{
+    long offset = first_ + i * block_size_;
+    return ( offset < size_ ) ? offset : size_;
+}
+
+bool BoundaryTable::claim( long i )
+{
+    long expected = UNRESOLVED;
+    return entries_[i].offset.compare_exchange_strong( expected, BUSY, std::memory_order_acquire );
+}
+
+void BoundaryTable::publish( long i, long offset, const std::string& key, bool searched )
+{
+    entries_[i].key = key;
+    entries_[i].offset.store( offset, std::memory_order_release );
+    if ( searched ) {
+        ++searches_;
+    } else {
+        ++shortcuts_;
+    }
+}
+
+long BoundaryTable::wait( long i )
+{
+    long offset = entries_[i].offset.load( std::memory_order_acquire );
+
+    if ( offset == BUSY ) {
+        ++waits_;
+        // the neighbor is in the middle of one search.
+        while ( (offset = entries_[i].offset.load( std::memory_order_acquire )) == BUSY ) {
+            std::this_thread::yield();
+        }
+    }
+
+    return offset;
+}
+
+bool BoundaryTable::peek( long i, long& offset, std::string& key ) const
+{
+    if ( i < 0 || i >= count_ - 1 ) return false;               // the end of the file has no key.
+
+    long o = entries_[i].offset.load( std::memory_order_acquire );
+    if ( o < 0 ) return false;
+
+    offset = o;
+    key = entries_[i].key;
+    return true;
+}
+
+long BoundaryTable::searches( void ) const
+{
+    return searches_;
+}
+
+long BoundaryTable::shortcuts( void ) const
+{
+    return shortcuts_;
+}
+
+long BoundaryTable::waits( void ) const
+{
+    return waits_;
+}
@@ -0,0 +1,143 @@
+#include "extract.hpp"
+
+#include <algorithm>
+
+Extractor::Extractor( BlockHandler& handler, long begin, long end, KeyModel::Type type, FileSplitter::LogPtr logger ) :
+    handler_{ handler },
+    begin_{ begin },
+    end_{ end },
+    type_{ type },
+    logger_{ logger },
+    probes_{ 0 }
+{
+}
+
+int Extractor::compare( const std::string& a, const std::string& b ) const
+{
+    int64_t va, vb;
+
+    if ( type_ != KeyModel::Type::STRING && KeyModel::value( type_, a.data(), a.size(), va ) && KeyModel::value( type_, b.data(), b.size(), vb ) ) {
+        return ( va < vb ) ? -1 : ( va > vb ) ? 1 : 0;
+    }
+
+    return a.compare( b );
+}
+
+long Extractor::bound( const std::string& key, bool after )
+{
+    const static std::string fnname{"Extractor::bound"};
+    std::string rkey;
+    long rsoff, rlen;
+
+    // lo and hi are record starts (or end): the records before lo are before the bound; the ones from hi are not.
+    long lo = begin_;
+    long hi = end_;
+
+    while ( lo < hi ) {
+        // the record holding the middle byte starts in [lo, hi) because both are record starts.
+        if ( (rsoff = handler_.setRecordMultiKey( lo + (hi - lo) / 2, rkey )) < 0 || (rlen = handler_.recordLength( rsoff )) <= 0 ) {
+            logger_->error( "{} unable to read the record at {}.", fnname, lo + (hi - lo) / 2 );
+            return -1;
+        }
+        ++probes_;
+
+        int c = compare( rkey, key );
+        if ( c < 0 || ( after && c == 0 ) ) {
+            lo = rsoff + rlen;
+        } else {
+            hi = rsoff;
+        }
+    }
+
+    return ( lo < end_ ) ? lo : end_;
+}
+
+bool Extractor::range( const std::string& first, const std::string& last, long& soff, long& len )
+{
+    const static std::string fnname{"Extractor::range"};
+    std::string rkey;
+    long e;
+
+    soff = bound( first, false );
+    len = 0;
+    if ( soff < 0 ) return false;
+    if ( soff >= end_ ) return true;
+
+    if ( first == last ) {
+        // a single key: its run starts at the bound when the key is there at all; gallop to its end.
+        if ( handler_.setRecordMultiKey( soff, rkey ) < 0 ) return false;
+        ++probes_;
+        if ( compare( rkey, first ) != 0 ) return true;
+
+        e = handler_.findNextRun( soff, end_ );
+    } else {
+        e = bound( last, true );
+    }
+
+    if ( e < 0 ) {
+        logger_->error( "{} unable to find the end of the keys [{}, {}].", fnname, first, last );
+        return false;
+    }
+
+    len = ( e > soff ) ? e - soff : 0;
+    return true;
+}
+
+bool Extractor::lookup( std::vector<std::string>& keys, std::vector<long>& begins, std::vector<long>& lengths )
+{
+    std::sort( keys.begin(), keys.end(), [this]( const std::string& a, const std::string& b ) { return compare( a, b ) < 0; } );
+    keys.erase( std::unique( keys.begin(), keys.end(), [this]( const std::string& a, const std::string& b ) { return compare( a, b ) == 0; } ), keys.end() );
+
+    // the bounds in this order have increasing answers: start(k0) <= end(k0) <= start(k1) ...
+    std::vector<Query> queries;
+    queries.reserve( 2 * keys.size() );
+    for ( const std::string& key : keys ) {
+        queries.push_back( Query{ &key, false, end_ } );
+        queries.push_back( Query{ &key, true, end_ } );
+    }
+
+    if ( !resolve( queries.begin(), queries.end(), begin_, end_ ) ) return false;
+
+    begins.resize( keys.size() );
+    lengths.resize( keys.size() );
+    for ( std::size_t i = 0; i < keys.size(); ++i ) {
+        begins[i] = queries[2*i].answer;
+        lengths[i] = queries[2*i+1].answer - queries[2*i].answer;
+    }
+
+    return true;
+}
+
+bool Extractor::resolve( std::vector<Query>::iterator first, std::vector<Query>::iterator last, long lo, long hi )
+{
+    const static std::string fnname{"Extractor::resolve"};
+    std::string rkey;
+    long rsoff, rlen;
+
+    // every answer in [first, last) is a record start in [lo, hi].
+    if ( first == last ) return true;
+
+    if ( lo >= hi ) {
+        for ( auto q = first; q != last; ++q ) q->answer = lo;
+        return true;
+    }
+
+    if ( (rsoff = handler_.setRecordMultiKey( lo + (hi - lo) / 2, rkey )) < 0 || (rlen = handler_.recordLength( rsoff )) <= 0 ) {
+        logger_->error( "{} unable to read the record at {}.", fnname, lo + (hi - lo) / 2 );
+        return false;
+    }
+    ++probes_;
+
+    // the bounds this record already satisfies are at or before it; the others are after it.
+    auto split = std::partition_point( first, last, [&]( const Query& q ) {
+        int c = compare( rkey, *q.key );
+        return c > 0 || ( c == 0 && !q.after );
+    } );
+
+    return resolve( first, split, lo, rsoff ) && resolve( split, last, rsoff + rlen, hi );
+}
+
+long Extractor::probes( void ) const
+{
+    return probes_;
+}
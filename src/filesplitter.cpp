@@ -1,12 +1,27 @@
 #include "filesplitter.hpp"
 #include "utilities.hpp"
+#include "scan.hpp"
+#include "planner.hpp"
+#include "interleave.hpp"
+#include "keymodel.hpp"
+#include "keyindex.hpp"
+#include "manifest.hpp"
+#include "slicereader.hpp"
+#include "extract.hpp"
+#include "stream.hpp"
+#include "scatter.hpp"
+#include <fstream>
 #include <sstream>
 #include <cmath>
+#include <cstring>
 #include <thread>
+#include <atomic>
 
 // for both windows and linux.
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 bool fileExists( const std::string& fn ) {
     static struct stat info;
@@ -20,6 +35,15 @@ bool fileExists( const std::string& fn ) {
     return false;
 }
 
+bool seekable( const std::string& fn ) {
+    struct stat info;
+
+    if ( fn == "-" ) return false;
+    // a missing file is reported by the regular split.
+    if ( stat( fn.c_str(), &info ) != 0 ) return true;
+    return S_ISREG( info.st_mode ) || S_ISBLK( info.st_mode );
+}
+
 bool dirExists( const std::string& dn ) {
     static struct stat info;
 
@@ -42,7 +66,9 @@ FileSplitter::FileSplitter(const std::string& name, const std::string& descripti
     ifsize_{ 0 },
     header_{},
     logger_{},
-    keylist_{}
+    keylist_{},
+    config_{ InputSource::Kind::MMAP, 0, Transfer::Method::COPY_FILE_RANGE, 0, 0, 0, SearchStrategy::AUTO, 0, 0, &stats_, nullptr, nullptr, nullptr },
+    stats_{}
 {
 }
 
@@ -166,6 +192,118 @@ long FileSplitter::initInputFile( std::string& ifname, std::string& header )
     return finfo.st_size;
 }
 
+bool FileSplitter::initInputSource( void )
+{
+    static std::string fnname{"initInputSource"};
+
+    struct stat finfo;
+
+    // default: map at most 1 TiB at once on 64-bit systems and 256 MiB on 32-bit systems.
+    config_.mapmax = (sizeof(void*) >= 8) ? (1L << 40) : (256L << 20);
+
+    if ( optIsSet('M') ) {
+        try {
+            config_.mapmax = static_cast<long>( optInt('M') ) << 20;
+        } catch ( std::exception& e ) {
+            logger_->warn("{} unreadable maximum mapping size: {}; using default.", fnname, optString('M'));
+        }
+    }
+
+    const std::string& input = optString('i');
+    if ( "stdio" == input ) {
+        config_.input = InputSource::Kind::STDIO;
+    } else if ( "mmap" == input ) {
+        config_.input = InputSource::Kind::MMAP;
+    } else if ( "pread" == input ) {
+        config_.input = InputSource::Kind::PREAD;
+    } else {
+        logger_->error("{} unknown input backend: {} ... halting.", fnname, input);
+        return false;
+    }
+
+    if ( !Transfer::parse( optString('x'), config_.transfer ) ) {
+        logger_->error("{} unknown transfer method: {} ... halting.", fnname, optString('x'));
+        return false;
+    }
+
+    if ( optIsSet('u') ) {
+        try {
+            int depth = optInt('u');
+            config_.uring = ( depth > 0 ) ? depth : 0;
+        } catch ( std::exception& e ) {
+            logger_->warn("{} unreadable io_uring queue depth: {}; io_uring is off.", fnname, optString('u'));
+        }
+    }
+
+    const std::string& search = optString('s');
+    if ( "auto" == search ) {
+        config_.search = SearchStrategy::AUTO;
+    } else if ( "gallop" == search ) {
+        config_.search = SearchStrategy::GALLOP;
+    } else if ( "bisect" == search ) {
+        config_.search = SearchStrategy::BISECT;
+    } else if ( "stream" == search ) {
+        config_.search = SearchStrategy::STREAM;
+    } else {
+        logger_->error("{} unknown search strategy: {} ... halting.", fnname, search);
+        return false;
+    }
+
+    if ( optIsSet('K') ) {
+        try {
+            int k = optInt('K');
+            config_.kary = ( k > 2 ) ? k : 0;
+        } catch ( std::exception& e ) {
+            logger_->warn("{} unreadable k-ary search width: {}; using bisection.", fnname, optString('K'));
+        }
+    }
+
+    // runs larger than a chunk are copied by several workers; 0 turns this off.
+    config_.chunk = 64L << 20;
+    if ( optIsSet('C') ) {
+        try {
+            config_.chunk = static_cast<long>( optInt('C') ) << 20;
+        } catch ( std::exception& e ) {
+            logger_->warn("{} unreadable chunk size: {}; using default.", fnname, optString('C'));
+        }
+    }
+    if ( config_.chunk < 0 ) config_.chunk = 0;
+
+    // the largest output; larger key runs are written in parts.  0 turns this off.
+    config_.maxpart = 0;
+    if ( optIsSet('z') ) {
+        try {
+            config_.maxpart = static_cast<long>( optInt('z') ) << 20;
+        } catch ( std::exception& e ) {
+            logger_->warn("{} unreadable maximum output size: {}; not splitting key runs.", fnname, optString('z'));
+        }
+    }
+    if ( config_.maxpart < 0 ) config_.maxpart = 0;
+    if ( config_.maxpart > 0 && config_.maxpart <= static_cast<long>( header_.length() ) ) {
+        logger_->error("{} the maximum output size ({} bytes) must be larger than the header ({} bytes) ... halting.", fnname, config_.maxpart, header_.length());
+        return false;
+    }
+
+    // the probe cache of the pread backend.
+    config_.cache = 4L << 20;
+    if ( optIsSet('c') ) {
+        try {
+            config_.cache = static_cast<long>( optInt('c') ) << 20;
+        } catch ( std::exception& e ) {
+            logger_->warn("{} unreadable probe cache size: {}; using default.", fnname, optString('c'));
+        }
+    }
+
+    // only regular files can be mapped (or read with pread at any offset).
+    if ( config_.input != InputSource::Kind::STDIO && ( stat( ifname_.c_str(), &finfo ) != 0 || !S_ISREG( finfo.st_mode ) ) ) {
+        logger_->info("{} {} is not a regular file; using the stdio input backend.", fnname, ifname_);
+        config_.input = InputSource::Kind::STDIO;
+    }
+
+    logger_->info("{} input backend: {}; maximum mapping: {} bytes; scanning with: {}; transfers with: {}; io_uring depth: {}.", fnname, (config_.input == InputSource::Kind::MMAP ? "mmap" : config_.input == InputSource::Kind::PREAD ? "pread" : "stdio"), config_.mapmax, scan::implementation(), Transfer::name( config_.transfer ), config_.uring);
+    return true;
+}
+
 const std::string& FileSplitter::getInputFileName( void ) const
 {
     return ifname_;
@@ -189,8 +327,9 @@ long FileSplitter::getFileSize( void ) const
 /**
  * Runner function.
  */
-int FileSplitter::splitFile( void ) {
-    static std::string fnname{"splitFile"};
+bool FileSplitter::initRun( std::size_t operand, bool seekable )
+{
+    static std::string fnname{"initRun"};
 
     std::string path{"logs/"};
     std::string logname{"filesplitter.log"};
@@ -206,32 +345,20 @@ int FileSplitter::splitFile( void ) {
 
     initLogger( logname, path );
 
-    if (!hasOperands()) {
+    if ( operands.size() <= operand ) {
         logger_->error("{} must have an input file... halting!", fnname);
-        return EXIT_FAILURE;
-    }
-
-    ifname_ = operands[0];
-    ifsize_ = initInputFile( ifname_, header_ );
-    if ( ifsize_ <= 0 ) {
-        logger_->error("{} The input file: {} size returned as {}; empty or an error with stat().", fnname, ifname_, ifsize_);
-        return EXIT_FAILURE;
+        return false;
     }
 
-    if ( optIsSet('o') ) {
-        odname_ = getOption('o').argument();
-    } // else use default.
-
-    if ( !initOutputDirectory( odname_ ) ) return EXIT_FAILURE;
-
-    int threads = std::thread::hardware_concurrency();
-
-    if ( optIsSet('t') ) {
-        try {
-            threads = optInt('t');
-        } catch ( std::exception& e ) {
-            // stick with default.
+    ifname_ = operands[operand];
+    if ( seekable ) {
+        ifsize_ = initInputFile( ifname_, header_ );
+        if ( ifsize_ <= 0 ) {
+            logger_->error("{} The input file: {} size returned as {}; empty or an error with stat().", fnname, ifname_, ifsize_);
+            return false;
         }
+
+        if ( !initInputSource() ) return false;
     }
 
     if ( optIsSet('k') ) {
@@ -254,328 +381,1586 @@ int FileSplitter::splitFile( void ) {
         std::sort( keylist_.begin(), keylist_.end() );
     }
 
-    std::vector<std::thread> thread_list;
-    long block_size = std::ceil(static_cast<double>(ifsize_ - header_.length())/static_cast<double>(threads));
+    return true;
+}
 
-    // initiate all the large block handler threads.
-    // starting offset will jump over the header.
-    for ( long b = header_.length(); b < ifsize_; b += block_size ) {
-        BlockHandler bh{ ifname_, odname_, ifsize_, header_, logger_, keylist_ };
+long FileSplitter::indexInterval( void )
+{
+    long interval = KeyIndex::DEFAULT_INTERVAL;
 
-        // call BlockHandler functor with two arguments: the block bounds, then throw it in the list.
-        thread_list.emplace_back( std::thread{ std::move(bh), b, b+block_size } );
+    if ( optIsSet('I') ) {
+        try {
+            interval = static_cast<long>( optInt('I') ) << 10;
+        } catch ( std::exception& e ) {
+            // stick with default.
+        }
     }
 
-    // join all the threads back to the main thread.
-    for ( auto& t : thread_list ) {
-        t.join();
+    return ( interval > 0 ) ? interval : KeyIndex::DEFAULT_INTERVAL;
+}
+
+int FileSplitter::indexFile( void )
+{
+    static std::string fnname{"indexFile"};
+
+    if ( !initRun( 1 ) ) return EXIT_FAILURE;
+
+    BlockHandler bh{ ifname_, odname_, ifsize_, header_, logger_, keylist_, config_ };
+    KeyIndex index{ logger_ };
+    std::string fn = KeyIndex::sidecarName( ifname_, keylist_ );
+
+    if ( !bh.open() || !index.build( bh, header_.length(), ifsize_, indexInterval() ) || !index.save( fn, ifname_, keylist_, header_.length() ) ) {
+        logger_->error( "{} unable to index {}.", fnname, ifname_ );
+        return EXIT_FAILURE;
     }
 
     return EXIT_SUCCESS;
 }
 
-int FileSplitter::operator()( void )
+bool FileSplitter::sliceRange( const KeySliceReader& reader, const std::string& first, const std::string& last, long& soff, long& len )
 {
-    return splitFile();
-}
+    static std::string fnname{"sliceRange"};
+
+    std::size_t i = reader.lowerBound( first );
+    std::size_t j = reader.lowerBound( last );
+    if ( j < reader.size() && reader.key( j ).str() == last ) ++j;
+
+    soff = 0;
+    len = 0;
+    if ( i >= j ) return true;
+
+    // the manifest is in bytewise key order; the runs of [first, last] are only one byte range if the input is too.
+    long b = reader.entry( i ).offset;
+    long e = b;
+    long total = 0;
+    for ( std::size_t k = i; k < j; ++k ) {
+        const Manifest::Entry& entry = reader.entry( k );
+        b = std::min<long>( b, entry.offset );
+        e = std::max<long>( e, entry.offset + entry.length );
+        total += entry.length;
+    }
 
-BlockHandler::BlockHandler( const std::string& ifname, const std::string& odname, long ifsize, const std::string& header, FileSplitter::LogPtr logger, const std::vector<uint32_t>& keylist ) :
-    ifname_{ ifname },
-    odname_{ odname },
-    ifsize_{ ifsize },
-    header_{ header },
-    logger_{ logger },
-    keylist_{ keylist },
-    bkey_{ 100, ' ' },
-    ckey_{ 100, ' ' }
-{
-}
+    if ( total != e - b ) {
+        logger_->error( "{} the keys [{}, {}] are not contiguous in {}; extract them without the manifest.", fnname, first, last, ifname_ );
+        return false;
+    }
 
-BlockHandler::~BlockHandler( void )
-{
+    soff = b;
+    len = total;
+    return true;
 }
 
-long BlockHandler::setRecordStartOffset( FILE* inf, long soff )
+int FileSplitter::extractFile( void )
 {
-    const static std::string fnname{"setRecordStartOffset"};
-    long i;
-    char c;
-
-    // soff bounds checking.
-    if ( soff < 0 ) soff = 0;
-    if ( soff >= ifsize_ ) soff = ifsize_ - 1;  // the last character in the file.
+    static std::string fnname{"extractFile"};
 
-    // process from soff backward to the begin.
-    i = soff;
-    // backup until we hit the header or byte 0.
-    while ( i > header_.length() ) {
-        if ( fseek( inf, i, SEEK_SET ) != 0 ) {
-            // this will trigger if the file is empty.
-            logger_->error( "{} fseek to {} returned non-zero.", fnname, i );
-            return -1;
-        }
-
-        // get the character at i.
-        if ( ( c = fgetc( inf ) ) != EOF ) {
-            // if a record terminator AND it wasn't the FIRST character, tell the next position: soff of record we were
-            // on.
-            if ( c == FileSplitter::rdelim && i < soff ) {
-                return ftell( inf );
-            }
+    if ( !initRun( 1 ) ) return EXIT_FAILURE;
 
-        } else {
-            logger_->warn( "{} EOF while searching backward in a file (shouldn't happen).", fnname );
-            return -1;
-        }
-        i--;
+    if ( operands.size() < 3 ) {
+        logger_->error( "{} extract needs a key... halting!", fnname );
+        return EXIT_FAILURE;
     }
 
-    if ( fseek( inf, i, SEEK_SET ) != 0 ) {
-        logger_->error( "{} fseek to {} returned non-zero.", fnname, i );
-        return -1;
+    std::string first = operands[2];
+    std::string last = ( operands.size() > 3 ) ? operands[3] : first;
+
+    KeyModel::Type type = KeyModel::Type::STRING;
+    if ( optIsSet('T') && !KeyModel::parse( optString('T'), type ) ) {
+        logger_->error( "{} unknown key type: {} ... halting.", fnname, optString('T') );
+        return EXIT_FAILURE;
     }
-    return i;
-}
 
-long BlockHandler::setRecordMultiKey( FILE* f, long soff, std::string& key ) 
-{
-    const static std::string fnname{"setRecordMultiKey"};
-    char c;
-    long rsoff;
-    uint32_t fdc{ 1 };           // field delimiter count.
-    bool collect{ true };
+    long soff = 0;
+    long len = 0;
 
-    rsoff = setRecordStartOffset( f, soff );
+    if ( optIsSet('m') ) {
+        // the plan command already found every run.
+        KeySliceReader reader{ logger_ };
+        if ( !reader.open( getOption('m').argument(), ifname_ ) || !sliceRange( reader, first, last, soff, len ) ) {
+            return EXIT_FAILURE;
+        }
+    } else {
+        BlockHandler bh{ ifname_, odname_, ifsize_, header_, logger_, keylist_, config_ };
+        Extractor extractor{ bh, static_cast<long>( header_.length() ), ifsize_, type, logger_ };
+        if ( !bh.open() || !extractor.range( first, last, soff, len ) ) {
+            logger_->error( "{} unable to search {}.", fnname, ifname_ );
+            return EXIT_FAILURE;
+        }
+        logger_->info( "{} {} probes found the keys [{}, {}] at [{}, {}).", fnname, extractor.probes(), first, last, soff, soff + len );
+    }
 
-    if ( rsoff < 0 ) {
-        logger_->error( "{} problem setting the record soff offset.", fnname );
-        return -1;
+    if ( len == 0 ) {
+        logger_->warn( "{} there are no records with keys in [{}, {}].", fnname, first, last );
+        return EXIT_FAILURE;
     }
 
-    // reset the "write" position into this string to the first address (the old key can be thrown away).
-    key.clear();                                    
-    // iterate through the key indicies we want to collect.
-    //std::vector<uint32_t>::const_iterator kit = keylist_.begin();
-    auto kit = keylist_.begin();
-
-    // build the key for this record from the start of this line in the file.
-    // we keep working while the key index list still has keys (it should be in order) AND
-    // the field delimiter count (how we find the right columns) remains less than the key index AND
-    // have a character from the line and we haven't reached the EOF.
-    // while ( kit != keylist_.end() && fdc <= *kit && (( c = fgetc(f) ) != EOF )) {
-    while ( kit != keylist_.end() && (( c = fgetc(f) ) != EOF )) {
-        if ( c == FileSplitter::rdelim ) break;
-        if ( c == FileSplitter::fdelim ) {
-            fdc++;
-            if (fdc > *kit) {
-                ++kit;
-                if ( kit != keylist_.end() ) key.push_back('.');
-            }
-        } else {
-            if ( fdc == *kit ) key.push_back(c);
-        }
+    int ofd = STDOUT_FILENO;
+    std::string ofn = optIsSet('O') ? getOption('O').argument() : std::string{};
+    if ( !ofn.empty() && (ofd = ::open( ofn.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666 )) < 0 ) {
+        logger_->error( "{} unable to create {}.", fnname, ofn );
+        return EXIT_FAILURE;
     }
 
-    if ( fseek( f, rsoff, SEEK_SET ) != 0 ) {
-        logger_->error( "{} fseek to {} returned non-zero.", fnname, rsoff );
-        return -1;
+    Transfer copier{ config_.transfer, logger_ };
+    bool ok = copier.open( ifname_ ) && Transfer::writeAll( ofd, header_.data(), header_.length() ) && copier.stream( ofd, soff, len ) == len;
+
+    if ( !ofn.empty() && ::close( ofd ) != 0 ) ok = false;
+    if ( !ok ) {
+        logger_->error( "{} failed to write the {} bytes at {}.", fnname, len, soff );
+        return EXIT_FAILURE;
     }
 
-    logger_->trace( "{} key = {}; set position to start = {}", fnname, key, rsoff );
-    return ftell(f);
+    return EXIT_SUCCESS;
 }
 
-long BlockHandler::setRecordKey( FILE* f, long soff, std::string& key ) 
+int FileSplitter::lookupFile( void )
 {
-    const static std::string fnname{"setRecordKey"};
-    char c;
-    long rsoff;
+    static std::string fnname{"lookupFile"};
 
-    rsoff = setRecordStartOffset( f, soff );
+    if ( !initRun( 1 ) ) return EXIT_FAILURE;
 
-    if ( rsoff < 0 ) {
-        logger_->error( "{} problem setting the record soff offset.", fnname );
-        return -1;
+    if ( operands.size() < 3 ) {
+        logger_->error( "{} lookup needs a file of keys... halting!", fnname );
+        return EXIT_FAILURE;
     }
 
-    // reset the "write" position into this string to the first address (the old key can be thrown away).
-    key.clear();                                    
-    while ( ( c = fgetc(f) ) != EOF ) {
-        if ( c == FileSplitter::fdelim || c == FileSplitter::rdelim ) {
-            break;                                                     // finished collecting the key.
-        }
-        key.push_back(c);
+    std::vector<std::string> keys;
+    std::ifstream kf{ operands[2] };
+    if ( !kf ) {
+        logger_->error( "{} unable to read the keys in {}.", fnname, operands[2] );
+        return EXIT_FAILURE;
     }
 
-    if ( fseek( f, rsoff, SEEK_SET ) != 0 ) {
-        logger_->error( "{} fseek to {} returned non-zero.", fnname, rsoff );
-        return -1;
+    for ( std::string line; std::getline( kf, line ); ) {
+        if ( !line.empty() && line.back() == '\r' ) line.pop_back();
+        if ( !line.empty() ) keys.push_back( line );
     }
 
-    logger_->trace( "{} key = {}; set position to start = {}", fnname, key, rsoff );
-    return ftell(f);
-}
+    KeyModel::Type type = KeyModel::Type::STRING;
+    if ( optIsSet('T') && !KeyModel::parse( optString('T'), type ) ) {
+        logger_->error( "{} unknown key type: {} ... halting.", fnname, optString('T') );
+        return EXIT_FAILURE;
+    }
 
-long BlockHandler::findFirstRecord( FILE* f, long soff, long end )
-{
-    const static std::string fnname{"findFirstRecord"};
-    long cpos;
-    long begin = header_.length();
+    std::vector<long> begins;
+    std::vector<long> lengths;
 
-    // boundary checking: soff \in [0,ifsize_]
-    if ( end > ifsize_ ) end = ifsize_;
-    if ( soff > end ) soff = end;
-    if ( soff < begin ) soff = begin;
+    if ( optIsSet('m') ) {
+        // the plan command already found every run.
+        KeySliceReader reader{ logger_ };
+        if ( !reader.open( getOption('m').argument(), ifname_ ) ) return EXIT_FAILURE;
 
-    // Get the record key for the record containing the starting offset.
-    //if ( (end = setRecordKey( f, soff, bkey_ )) < 0 ) {
-    if ( (end = setRecordMultiKey( f, soff, bkey_ )) < 0 ) {
-        logger_->error( "{} error code from setRecordKey.", fnname );
-        return -1;
+        std::sort( keys.begin(), keys.end() );
+        keys.erase( std::unique( keys.begin(), keys.end() ), keys.end() );
+        begins.resize( keys.size() );
+        lengths.resize( keys.size() );
+        for ( std::size_t i = 0; i < keys.size(); ++i ) {
+            if ( !sliceRange( reader, keys[i], keys[i], begins[i], lengths[i] ) ) return EXIT_FAILURE;
+        }
+    } else {
+        BlockHandler bh{ ifname_, odname_, ifsize_, header_, logger_, keylist_, config_ };
+        Extractor extractor{ bh, static_cast<long>( header_.length() ), ifsize_, type, logger_ };
+        if ( !bh.open() || !extractor.lookup( keys, begins, lengths ) ) {
+            logger_->error( "{} unable to search {}.", fnname, ifname_ );
+            return EXIT_FAILURE;
+        }
+        logger_->info( "{} {} probes found the runs of {} keys.", fnname, extractor.probes(), keys.size() );
     }
 
-    soff = std::ceil( (begin + end) / 2.0);
-
-    // as intended, this loop will not be entered if we are searching anywhere in the first record.
-    while ( soff > begin && soff < end ) {
+    // one framed stream: each key is a line "<bytes> <key>" followed by that many bytes (its header and records).
+    int ofd = -1;
+    std::string ofn = optIsSet('O') ? getOption('O').argument() : std::string{};
+    if ( ofn == "-" ) {
+        ofd = STDOUT_FILENO;
+    } else if ( !ofn.empty() && (ofd = ::open( ofn.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666 )) < 0 ) {
+        logger_->error( "{} unable to create {}.", fnname, ofn );
+        return EXIT_FAILURE;
+    }
 
-        //cpos = setRecordKey( f, soff, ckey_ );
-        cpos = setRecordMultiKey( f, soff, ckey_ );
+    // otherwise one file per key, as a split would write it.
+    if ( ofd < 0 ) {
+        if ( optIsSet('o') ) {
+            odname_ = getOption('o').argument();
+        }
+        if ( !initOutputDirectory( odname_ ) ) return EXIT_FAILURE;
+    }
 
-        if ( ckey_ == bkey_ ) {
-            // continue to jump toward beginning of file.
-            end = cpos;
+    Transfer copier{ config_.transfer, logger_ };
+    bool ok = copier.open( ifname_ );
+    long missing = 0;
 
+    for ( std::size_t i = 0; ok && i < keys.size(); ++i ) {
+        if ( lengths[i] == 0 ) {
+            logger_->debug( "{} there are no records with key {}.", fnname, keys[i] );
+            ++missing;
+        } else if ( ofd < 0 ) {
+            ok = copier.toFile( odname_ + keys[i] + ".csv", header_, begins[i], lengths[i] ) == lengths[i];
         } else {
-            // jump toward end of file.
-            begin = soff;
+            std::string frame = std::to_string( header_.length() + lengths[i] ) + " " + keys[i] + "\n";
+            ok = Transfer::writeAll( ofd, frame.data(), frame.length() ) && Transfer::writeAll( ofd, header_.data(), header_.length() ) && copier.stream( ofd, begins[i], lengths[i] ) == lengths[i];
         }
+    }
 
-        soff = std::ceil( (begin + end) / 2.0);
-        logger_->trace( "{} ckey={} bkey={} begin={} cpos={} end={} soff={}", fnname, ckey_, bkey_, begin, cpos, end, soff );
+    if ( ofd >= 0 && ofd != STDOUT_FILENO && ::close( ofd ) != 0 ) ok = false;
+    if ( !ok ) {
+        logger_->error( "{} failed to write the records of the keys.", fnname );
+        return EXIT_FAILURE;
     }
 
-    // make sure we are at the beginning of the record
-    return setRecordStartOffset( f, soff );
+    if ( missing > 0 ) {
+        logger_->warn( "{} {} of the {} keys are not in {}.", fnname, missing, keys.size(), ifname_ );
+    }
+
+    return EXIT_SUCCESS;
 }
 
-void BlockHandler::operator()( long begin, long end )
+int FileSplitter::streamFile( void )
 {
-    const static std::string fnname{"BH Runner"};
-
-    std::string fn{ odname_ };
+    static std::string fnname{"streamFile"};
 
-    FILE* inf = fopen( ifname_.c_str(), "rb" );
+    if ( !initRun( 0, false ) ) return EXIT_FAILURE;
 
-    logger_->trace( "{} block original bounds [{},{})", fnname, begin, end );
-    if ( (begin = findFirstRecord( inf, begin, end )) < 0 ) {
-        return;
+    if ( optIsSet('U') || optIsSet('P') || optIsSet('S') ) {
+        logger_->error( "{} an unsorted (-U), partitioned (-P) or sharded (-S) split needs a regular file; {} can only be read in order... halting!", fnname, ifname_ );
+        return EXIT_FAILURE;
     }
 
-    logger_->trace( "{} block new start: {} with key: {}.", fnname, begin, bkey_ );
+    if ( optIsSet('o') ) {
+        odname_ = getOption('o').argument();
+    } // else use default.
 
-    fn += bkey_;
+    if ( !initOutputDirectory( odname_ ) ) return EXIT_FAILURE;
 
-    if ( end >= ifsize_ ) end = ifsize_;
-    else {
-        // search for the first record starting on the last line.
-        if ( (end = findFirstRecord( inf, end, end )) < 0 ) {
-            return;
+    // the scan is one thread, so the threads asked for write.
+    int writers = std::thread::hardware_concurrency();
+    if ( optIsSet('w') || optIsSet('t') ) {
+        try {
+            writers = optInt( optIsSet('w') ? 'w' : 't' );
+        } catch ( std::exception& e ) {
+            // stick with default.
         }
     }
+    if ( writers < 1 ) writers = 1;
 
-    logger_->trace( "{}: block new end: {} with key: {}.", fnname, end, bkey_ );
-
-    fn += "-" + bkey_ + ".csv";
-
-    if ( begin == end ) {
-        logger_->trace( "{}: homogeonous key, so empty block.", fnname );
+    int fd = ( ifname_ == "-" ) ? STDIN_FILENO : ::open( ifname_.c_str(), O_RDONLY );
+    if ( fd < 0 ) {
+        logger_->error( "{} Cannot open the input: {}.", fnname, ifname_ );
+        return EXIT_FAILURE;
     }
 
-    long total_bytes = end - begin;
-    logger_->trace( "{}: Total Bytes to Write: {}.", fnname, total_bytes );
+    logger_->info( "{} splitting {} in one pass with {} write threads.", fnname, ifname_, writers );
 
-    // for testing, just write the entire block at key boundaries for this block.
-    // transfer( begin, end - begin, fn ); 
+    StreamSplitter splitter{ odname_, optIsSet('H'), keylist_, static_cast<unsigned>( writers ), logger_ };
+    bool ok = splitter.split( fd );
 
-    // move from back to front now that we have our boundaries and write out each block.
-    // the search is a binary search (logarithmic time).
-    std::string ofname{};
-    while ( end > begin ) {
-        // end - 1 moves into the last byte of the block of interest or begin = end - 1 which will halt execution.
-        long epos = findFirstRecord( inf, end - 1, end );
-        ofname = odname_ + bkey_ + ".csv";
-        long r = transfer( epos, end - epos, ofname );
-        logger_->trace( "{}: begin: {} epos: {} end: {}", fnname, begin, epos, end);
-        logger_->trace( "{}: Attempting to write: {}; Wrote {} bytes for key {}", fnname, end-epos, r, bkey_ );
-        total_bytes -= r;
-        end = epos;
-    }
-    logger_->trace( "{}: Output Bytes Status: {}.", fnname, total_bytes );
+    if ( fd != STDIN_FILENO ) ::close( fd );
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
-long BlockHandler::transfer( long soff, long bytes_to_write, const std::string& ofn )
+int FileSplitter::scatterFile( void )
 {
-    const static std::string fnname{"transfer"};
-    long bytes_read{0};
-    long bytes_written{0};
-    long block_size{0};
-    long total_bytes{0};
-
-    FILE* source = fopen( ifname_.c_str(), "rb" );
-    FILE* dest = fopen( ofn.c_str(), "wb" );
-
-    if (!source) {
-        logger_->error( "{} Failed to open source file: {}", fnname, ifname_ );
-        return -1;
-    }
-
-    if (!dest) {
-        logger_->error( "{} Failed to open destination file: {}", fnname, ofn );
-        return -1;
-    }
+    static std::string fnname{"scatterFile"};
 
-    if ( header_.length() > 0 ) {
-        // header includes the newline.
-        fwrite( header_.c_str(), sizeof(char), header_.length(), dest );
-    }
+    if ( !initRun( 0 ) ) return EXIT_FAILURE;
 
-    if ( fseek( source, soff, SEEK_SET ) != 0 ) {
-        logger_->error( "{} failure to seek to soff of source block: {}", fnname, soff );
-        return total_bytes;
-    }
+    if ( optIsSet('o') ) {
+        odname_ = getOption('o').argument();
+    } // else use default.
 
-    while ( bytes_to_write > 0 && !feof( source ) ) {
+    if ( !initOutputDirectory( odname_ ) ) return EXIT_FAILURE;
 
-        block_size = ( bytes_to_write < BUFSIZE ) ? bytes_to_write : BUFSIZE;
+    int threads = std::thread::hardware_concurrency();
+    if ( optIsSet('t') ) {
+        try {
+            threads = optInt('t');
+        } catch ( std::exception& e ) {
+            // stick with default.
+        }
+    }
+    if ( threads < 1 ) threads = 1;
+
+    long files = DescriptorPool::limit();
+    if ( optIsSet('F') ) {
+        try {
+            files = std::min<long>( files, optInt('F') );
+        } catch ( std::exception& e ) {
+            // stick with default.
+        }
+    }
+
+    int partitions = 0;
+    if ( optIsSet('P') ) {
+        try {
+            partitions = optInt('P');
+        } catch ( std::exception& e ) {
+            // stick with default.
+        }
+        if ( partitions < 1 ) {
+            logger_->error( "{} the number of partitions must be at least 1... halting!", fnname );
+            return EXIT_FAILURE;
+        }
+    }
+
+    logger_->info( "{} scattering {} into {} with {} threads; at most {} outputs open at once.", fnname, ifname_, partitions > 0 ? std::to_string( partitions ) + " hash partitions" : std::string{"one file per key"}, threads, files );
+
+    DescriptorPool pool{ odname_, header_, files, logger_ };
+    Scatter scatter{ ifname_, ifsize_, header_, pool, keylist_, static_cast<unsigned>( partitions ), logger_ };
+    bool ok = scatter.run( static_cast<unsigned>( threads ) );
+
+    if ( !pool.close() ) {
+        logger_->error( "{} Failed to close the outputs.", fnname );
+        ok = false;
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int FileSplitter::shardFile( void )
+{
+    static std::string fnname{"shardFile"};
+
+    if ( !initRun( 0 ) ) return EXIT_FAILURE;
+
+    if ( optIsSet('o') ) {
+        odname_ = getOption('o').argument();
+    } // else use default.
+
+    if ( !initOutputDirectory( odname_ ) ) return EXIT_FAILURE;
+
+    int shards = 0;
+    try {
+        shards = optInt('S');
+    } catch ( std::exception& e ) {
+        // reported below.
+    }
+    if ( shards < 1 ) {
+        logger_->error( "{} the number of shards must be at least 1... halting!", fnname );
+        return EXIT_FAILURE;
+    }
+
+    int threads = std::thread::hardware_concurrency();
+    if ( optIsSet('t') ) {
+        try {
+            threads = optInt('t');
+        } catch ( std::exception& e ) {
+            // stick with default.
+        }
+    }
+    if ( threads < 1 ) threads = 1;
+
+    // move every even cut to the nearer end of the key run it falls in, so no key straddles two shards.
+    long hlen = header_.length();
+    std::vector<long> cuts{ hlen };
+    BlockHandler bh{ ifname_, odname_, ifsize_, header_, logger_, keylist_, config_ };
+    if ( !bh.open() ) return EXIT_FAILURE;
+
+    for ( int i = 1; i < shards; ++i ) {
+        long target = hlen + static_cast<long>( static_cast<double>( ifsize_ - hlen ) * i / shards );
+        long cut = cuts.back();
+
+        if ( target > cut && target < ifsize_ ) {
+            long b = bh.findFirstRecord( target, ifsize_ );
+            long e = ( b >= 0 ) ? bh.findNextRun( b, ifsize_ ) : -1;
+            if ( b < 0 || e < 0 ) {
+                logger_->error( "{} unable to find the key run at {}.", fnname, target );
+                return EXIT_FAILURE;
+            }
+            cut = std::max( cut, ( target - b <= e - target ) ? b : e );
+        }
+
+        cuts.push_back( cut );
+    }
+    cuts.push_back( ifsize_ );
+    bh.close();
+
+    // the shards are large sequential copies; the threads take them in order.
+    std::atomic<int> next{ 0 };
+    std::atomic<bool> ok{ true };
+    std::vector<std::thread> thread_list;
+
+    for ( int w = 0; w < std::min( threads, shards ); ++w ) {
+        thread_list.emplace_back( [this, &cuts, &next, &ok, shards] {
+            Transfer copier{ config_.transfer, logger_ };
+            if ( !copier.open( ifname_ ) ) {
+                ok = false;
+                return;
+            }
+
+            for ( int i; (i = next++) < shards; ) {
+                char name[32];
+                std::snprintf( name, sizeof name, "shard-%05d.csv", i );
+                long len = cuts[i+1] - cuts[i];
+                if ( copier.toFile( odname_ + name, header_, cuts[i], len ) != len ) ok = false;
+            }
+        } );
+    }
+
+    for ( auto& t : thread_list ) {
+        t.join();
+    }
+
+    for ( int i = 0; i < shards; ++i ) {
+        logger_->debug( "{} shard {}: [{}, {}) {} bytes.", fnname, i, cuts[i], cuts[i+1], cuts[i+1] - cuts[i] );
+    }
+    logger_->info( "{} {} shards of {} ({} bytes each on average).", fnname, shards, ifname_, (ifsize_ - hlen) / shards );
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int FileSplitter::splitFile( bool plan ) {
+    static std::string fnname{"splitFile"};
+
+    if ( !initRun( plan ? 1 : 0 ) ) return EXIT_FAILURE;
+
+    if ( optIsSet('o') ) {
+        odname_ = getOption('o').argument();
+    } // else use default.
+
+    if ( !initOutputDirectory( odname_ ) ) return EXIT_FAILURE;
+
+    int threads = std::thread::hardware_concurrency();
+
+    if ( optIsSet('t') ) {
+        try {
+            threads = optInt('t');
+        } catch ( std::exception& e ) {
+            // stick with default.
+        }
+    }
+
+    if ( threads < 1 ) threads = 1;
+
+    int ranges = 16;
+    if ( optIsSet('r') ) {
+        try {
+            ranges = optInt('r');
+        } catch ( std::exception& e ) {
+            // stick with default.
+        }
+    }
+    if ( ranges < 1 ) ranges = 1;
+
+    // cut the file into many small ranges and deal them out so each worker starts with a contiguous part of the file;
+    // workers that run out steal ranges (and hand-off key runs) from the others.
+    long nblocks = static_cast<long>( threads ) * ranges;
+    long block_size = std::ceil(static_cast<double>(ifsize_ - header_.length())/static_cast<double>(nblocks));
+    if ( block_size < 1 ) block_size = 1;
+
+    Scheduler scheduler{ static_cast<unsigned>( threads ) };
+    long hlen = header_.length();
+    nblocks = (ifsize_ - hlen + block_size - 1) / block_size;
+
+    // planning phase: sample the keys and pick a search strategy for each range.
+    std::unique_ptr<Planner> planner;
+    BlockHandler sampler{ ifname_, odname_, ifsize_, header_, logger_, keylist_, config_ };
+    bool sampling = sampler.open();
+    if ( config_.search == SearchStrategy::AUTO ) {
+        int samples = 1024;
+        if ( optIsSet('p') ) {
+            try {
+                samples = optInt('p');
+            } catch ( std::exception& e ) {
+                // stick with default.
+            }
+        }
+
+        if ( samples > 0 && sampling ) {
+            planner.reset( new Planner{ sampler, hlen, ifsize_, logger_ } );
+            if ( !planner->sample( samples ) ) planner.reset();
+        }
+    }
+
+    // the sidecar index: reuse it when it still matches the input, otherwise build it now for this and later runs.
+    std::unique_ptr<KeyIndex> index;
+    if ( optIsSet('I') && sampling ) {
+        std::string fn = KeyIndex::sidecarName( ifname_, keylist_ );
+        index.reset( new KeyIndex{ logger_ } );
+        if ( !index->load( fn, ifname_, keylist_, hlen ) ) {
+            if ( index->build( sampler, hlen, ifsize_, indexInterval() ) ) {
+                index->save( fn, ifname_, keylist_, hlen );
+            } else {
+                index.reset();
+            }
+        }
+        config_.index = index.get();
+    }
+
+    // a typed key: learn where the keys are from an even sample before any searching.
+    std::unique_ptr<KeyModel> model;
+    if ( optIsSet('T') ) {
+        KeyModel::Type type;
+        if ( !KeyModel::parse( optString('T'), type ) ) {
+            logger_->error( "{} unknown key type: {} ... halting.", fnname, optString('T') );
+            return EXIT_FAILURE;
+        }
+
+        if ( type == KeyModel::Type::STRING ) {
+            // nothing to learn.
+        } else if ( keylist_.size() != 1 ) {
+            logger_->warn( "{} typed keys need a single key field; searching without a model.", fnname );
+        } else if ( sampling ) {
+            model.reset( new KeyModel{ type, logger_ } );
+            if ( model->build( sampler, hlen, ifsize_ ) ) {
+                config_.model = model.get();
+            }
+        }
+    }
+
+    // starting offset will jump over the header; push from the back so each worker's back is its first range.
+    long counts[4] = { 0, 0, 0, 0 };
+    for ( long i = nblocks - 1; i >= 0; --i ) {
+        long b = hlen + i * block_size;
+        SearchStrategy search = config_.search;
+        if ( planner ) {
+            search = planner->choose( b, b + block_size );
+        } else if ( search == SearchStrategy::AUTO ) {
+            search = SearchStrategy::GALLOP;
+        }
+        ++counts[ static_cast<int>( search ) ];
+        scheduler.push( static_cast<unsigned>( i * threads / nblocks ), BlockTask{ BlockTask::Kind::BLOCK, b, b + block_size, std::string{}, 0, search } );
+    }
+    sampler.close();
+
+    BoundaryTable boundaries{ hlen, ifsize_, nblocks, block_size };
+
+    // resolve all of the boundaries up front from this thread, with many searches in flight at once.
+    int inflight = 0;
+    if ( optIsSet('q') ) {
+        try {
+            inflight = optInt('q');
+        } catch ( std::exception& e ) {
+            // stick with default.
+        }
+    }
+
+    if ( inflight > 0 ) {
+        InterleavedSearch searcher{ static_cast<unsigned>( inflight ), keylist_, logger_ };
+        if ( !InterleavedSearch::available() ) {
+            logger_->warn( "{} built without FILESPLITTER_COROUTINES; the block threads will resolve the boundaries.", fnname );
+        } else if ( searcher.open( ifname_, ifsize_, hlen ) ) {
+            searcher.resolve( boundaries, 0, nblocks );
+            searcher.close();
+        }
+    }
+
+    logger_->info( "{} search strategies: bisect {} ranges; gallop {} ranges; stream {} ranges.", fnname, counts[0], counts[1], counts[2] );
+
+    // plan mode: every key run goes into the manifest, so there is nothing for write workers to do.
+    std::unique_ptr<Manifest> manifest;
+    if ( plan ) {
+        manifest.reset( new Manifest{ static_cast<unsigned>( threads ), logger_ } );
+        config_.manifest = manifest.get();
+    }
+
+    int writers = 0;
+    if ( !plan && optIsSet('w') ) {
+        try {
+            writers = optInt('w');
+        } catch ( std::exception& e ) {
+            // stick with default.
+        }
+    }
+
+    std::unique_ptr<Pipeline> pipeline;
+    std::vector<std::thread> writer_list;
+
+    if ( writers > 0 ) {
+        pipeline.reset( new Pipeline{ static_cast<unsigned>( writers ) } );
+
+        // start the write workers first; they wait for the searchers to fill the queue.
+        for ( int w = 0; w < writers; ++w ) {
+            BlockHandler bh{ ifname_, odname_, ifsize_, header_, logger_, keylist_, config_ };
+            writer_list.emplace_back( std::thread{ std::move(bh), std::ref( *pipeline ) } );
+        }
+    }
+
+    logger_->info( "{} {} threads working on {} ranges of {} bytes; {} write threads.", fnname, threads, nblocks, block_size, writers );
+
+    std::vector<std::thread> thread_list;
+
+    // initiate all the block handler threads.
+    for ( int w = 0; w < threads; ++w ) {
+        BlockHandler bh{ ifname_, odname_, ifsize_, header_, logger_, keylist_, config_ };
+
+        // call BlockHandler functor with the scheduler and its worker index, then throw it in the list.
+        thread_list.emplace_back( std::thread{ std::move(bh), std::ref( scheduler ), static_cast<unsigned>( w ), pipeline.get(), &boundaries } );
+    }
+
+    // join all the threads back to the main thread.
+    for ( auto& t : thread_list ) {
+        t.join();
+    }
+
+    // the searches are done; the writers finish what is queued.
+    if ( pipeline ) {
+        pipeline->finish();
+        for ( auto& t : writer_list ) {
+            t.join();
+        }
+        logger_->info( "{} the searchers found the write queue full {} times; the writers found it empty {} times.", fnname, pipeline->stalls(), pipeline->starves() );
+    }
+
+    if ( config_.model ) {
+        logger_->info( "{} key model: {} predictions; {} bracketed the boundary.", fnname, stats_.predictions.load(), stats_.prediction_hits.load() );
+    }
+
+    if ( config_.input == InputSource::Kind::PREAD ) {
+        logger_->info( "{} probe cache: {} hits; {} misses; {} evictions; key memo: {} hits; {} misses.", fnname, stats_.hits.load(), stats_.misses.load(), stats_.evictions.load(), stats_.memo_hits.load(), stats_.memo_misses.load() );
+    }
+
+    logger_->info( "{} finished; {} tasks were stolen; {} boundaries searched, {} taken from a neighbor's run, {} waits for a neighbor.", fnname, scheduler.steals(), boundaries.searches(), boundaries.shortcuts(), boundaries.waits() );
+
+    if ( manifest && !writeManifest( *manifest ) ) return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
+
+bool FileSplitter::writeManifest( Manifest& manifest )
+{
+    static std::string fnname{"writeManifest"};
+
+    std::string fn = odname_ + "manifest.fsm";
+    if ( optIsSet('m') ) {
+        fn = getOption('m').argument();
+    }
+
+    if ( !manifest.finish( ifname_, optIsSet('n') ) || !manifest.write( fn, ifname_, header_ ) ) {
+        logger_->error( "{} unable to write the manifest {}.", fnname, fn );
+        return false;
+    }
+
+    // the text views sit next to the binary manifest.
+    std::string base = ( fn.size() > 4 && fn.compare( fn.size() - 4, 4, ".fsm" ) == 0 ) ? fn.substr( 0, fn.size() - 4 ) : fn;
+    StrVector views;
+    if ( optIsSet('f') ) {
+        views = string_utilities::split( getOption('f').argument() );
+    }
+
+    for ( const std::string& view : views ) {
+        bool ok = true;
+        if ( "csv" == view ) {
+            ok = manifest.writeCSV( base + ".csv" );
+        } else if ( "json" == view ) {
+            ok = manifest.writeJSON( base + ".json" );
+        } else if ( "binary" != view ) {
+            logger_->warn( "{} unknown manifest view: {}.", fnname, view );
+        }
+
+        if ( !ok ) {
+            logger_->error( "{} unable to write the {} view of the manifest {}.", fnname, view, fn );
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int FileSplitter::operator()( void )
+{
+    // filesplitter index [options] file
+    if ( operands.size() >= 2 && operands[0] == "index" ) {
+        return indexFile();
+    }
+
+    // filesplitter extract [options] file key [last]
+    if ( operands.size() >= 2 && operands[0] == "extract" ) {
+        return extractFile();
+    }
+
+    // filesplitter lookup [options] file keyfile
+    if ( operands.size() >= 2 && operands[0] == "lookup" ) {
+        return lookupFile();
+    }
+
+    // filesplitter plan [options] file
+    if ( operands.size() >= 2 && operands[0] == "plan" ) {
+        return splitFile( true );
+    }
+
+    // filesplitter [options] -|fifo: the input can only be read once, in order.
+    if ( !operands.empty() && !seekable( operands[0] ) ) {
+        return streamFile();
+    }
+
+    // filesplitter -S N [options] file: a sorted input cut into N shards of about the same size.
+    if ( optIsSet('S') ) {
+        return shardFile();
+    }
+
+    // filesplitter -U|-P N [options] file: the input is not sorted by key, or goes to hash buckets.
+    if ( optIsSet('U') || optIsSet('P') ) {
+        return scatterFile();
+    }
+
+    return splitFile();
+}
+
+BlockHandler::BlockHandler( const std::string& ifname, const std::string& odname, long ifsize, const std::string& header, FileSplitter::LogPtr logger, const std::vector<uint32_t>& keylist, const SplitConfig& config ) :
+    ifname_{ ifname },
+    odname_{ odname },
+    ifsize_{ ifsize },
+    header_{ header },
+    logger_{ logger },
+    keylist_{ keylist },
+    config_{ config },
+    input_{},
+    copier_{ config.transfer, logger },
+    uring_{},
+    scheduler_{ nullptr },
+    worker_{ 0 },
+    pipeline_{ nullptr },
+    boundaries_{ nullptr },
+    bkey_{ 100, ' ' },
+    fields_{},
+    probes_{},
+    memo_{},
+    memo_hits_{ 0 },
+    memo_misses_{ 0 },
+    predictions_{ 0 },
+    prediction_hits_{ 0 }
+{
+}
+
+BlockHandler::~BlockHandler( void )
+{
+}
+
+long BlockHandler::setRecordStartOffset( long soff )
+{
+    const static std::string fnname{"setRecordStartOffset"};
+    const char* p;
+    const char* q;
+    long hi, wlo, n;
+    long lo = header_.length() + 1;
+
+    // soff bounds checking.
+    if ( soff < 0 ) soff = 0;
+    if ( soff >= ifsize_ ) soff = ifsize_ - 1;  // the last character in the file.
+
+    // process from soff backward to the begin, one page-aligned window at a time; the character at soff itself does
+    // not count (it may be the terminator of the record we are in).
+    hi = soff;
+    while ( hi > lo ) {
+        wlo = ( (hi - 1) / PAGESIZE ) * PAGESIZE;
+        if ( wlo < lo ) wlo = lo;
+        n = hi - wlo;
+
+        if ( (p = input_->view( wlo, n )) == nullptr ) {
+            logger_->error( "{} unable to read {} bytes at {}.", fnname, n, wlo );
+            return -1;
+        }
+
+        // a record terminator: the record we were on starts right after it.
+        if ( (q = scan::findLast( p, n, FileSplitter::rdelim )) != nullptr ) {
+            return wlo + (q - p) + 1;
+        }
+
+        hi = wlo;
+    }
+
+    // backed up to the header or byte 0.
+    return ( soff < lo ) ? soff : lo - 1;
+}
+
+long BlockHandler::recordView( long rsoff, const char*& rec )
+{
+    const char* p;
+    const char* e;
+    long avail;
+    long len = BUFSIZE;
+
+    // widen the view until it holds the record delimiter or the end of the file.
+    while ( (p = input_->view( rsoff, len )) != nullptr ) {
+        avail = ( len < ifsize_ - rsoff ) ? len : ifsize_ - rsoff;
+        e = static_cast<const char*>( std::memchr( p, FileSplitter::rdelim, avail ) );
+
+        if ( e ) {
+            rec = p;
+            return e - p;
+        }
+
+        if ( avail < len ) {
+            // the last record in the file is not terminated.
+            rec = p;
+            return avail;
+        }
+
+        len *= 2;
+    }
+
+    return -1;
+}
+
+long BlockHandler::setRecordFields( long soff, std::vector<scan::Span>& fields )
+{
+    const static std::string fnname{"setRecordFields"};
+    const char* rec;
+    long rsoff, rlen;
+
+    rsoff = setRecordStartOffset( soff );
+
+    if ( rsoff < 0 ) {
+        logger_->error( "{} problem setting the record soff offset.", fnname );
+        return -1;
+    }
+
+    if ( (rlen = recordView( rsoff, rec )) < 0 ) {
+        logger_->error( "{} unable to read the record at {}.", fnname, rsoff );
+        return -1;
+    }
+
+    scan::fields( rec, rlen, FileSplitter::fdelim, keylist_, fields );
+    return rsoff;
+}
+
+long BlockHandler::probeKey( long soff, const std::string& key, bool& same )
+{
+    const static std::string fnname{"probeKey"};
+    long rsoff;
+
+    if ( memo_.empty() ) {
+        if ( (rsoff = setRecordFields( soff, fields_ )) < 0 ) return -1;
+        same = scan::equals( fields_, '.', key );
+        return rsoff;
+    }
+
+    if ( (rsoff = setRecordStartOffset( soff )) < 0 ) {
+        logger_->error( "{} problem setting the record soff offset.", fnname );
+        return -1;
+    }
+
+    // direct mapped on the record start.
+    MemoEntry& m = memo_[ (static_cast<unsigned long>( rsoff ) * 0x9E3779B97F4A7C15UL) >> 54 ];
+    if ( m.rsoff == rsoff ) {
+        ++memo_hits_;
+    } else {
+        const char* rec;
+        long rlen;
+
+        ++memo_misses_;
+        if ( (rlen = recordView( rsoff, rec )) < 0 ) {
+            logger_->error( "{} unable to read the record at {}.", fnname, rsoff );
+            return -1;
+        }
+
+        scan::fields( rec, rlen, FileSplitter::fdelim, keylist_, fields_ );
+        scan::join( fields_, '.', m.key );
+        m.rsoff = rsoff;
+    }
+
+    same = ( m.key == key );
+    return rsoff;
+}
+
+long BlockHandler::setRecordMultiKey( long soff, std::string& key ) 
+{
+    const static std::string fnname{"setRecordMultiKey"};
+    long rsoff;
+
+    if ( (rsoff = setRecordFields( soff, fields_ )) < 0 ) {
+        return -1;
+    }
+
+    // the key fields are joined with '.'
+    scan::join( fields_, '.', key );
+
+    logger_->trace( "{} key = {}; set position to start = {}", fnname, key, rsoff );
+    return rsoff;
+}
+
+long BlockHandler::setRecordKey( long soff, std::string& key ) 
+{
+    const static std::string fnname{"setRecordKey"};
+    const char* rec;
+    long rsoff, rlen;
+
+    rsoff = setRecordStartOffset( soff );
+
+    if ( rsoff < 0 ) {
+        logger_->error( "{} problem setting the record soff offset.", fnname );
+        return -1;
+    }
+
+    if ( (rlen = recordView( rsoff, rec )) < 0 ) {
+        logger_->error( "{} unable to read the record at {}.", fnname, rsoff );
+        return -1;
+    }
+
+    // the key is everything up to the first field delimiter.
+    const char* e = static_cast<const char*>( std::memchr( rec, FileSplitter::fdelim, rlen ) );
+    key.assign( rec, e ? e - rec : rlen );
+
+    logger_->trace( "{} key = {}; set position to start = {}", fnname, key, rsoff );
+    return rsoff;
+}
+
+long BlockHandler::findFirstRecord( long soff, long end, long lower )
+{
+    const static std::string fnname{"findFirstRecord"};
+    long cpos;
+    bool same;
+    long begin = header_.length();
+
+    if ( lower > begin ) begin = lower;
+
+    // boundary checking: soff \in [0,ifsize_]
+    if ( end > ifsize_ ) end = ifsize_;
+    if ( soff > end ) soff = end;
+    if ( soff < begin ) soff = begin;
+
+    // Get the record key for the record containing the starting offset.
+    //if ( (end = setRecordKey( soff, bkey_ )) < 0 ) {
+    if ( (end = setRecordMultiKey( soff, bkey_ )) < 0 ) {
+        logger_->error( "{} error code from setRecordKey.", fnname );
+        return -1;
+    }
+
+    // the sidecar index brackets the run start between two of its entries.
+    if ( config_.index ) {
+        config_.index->narrowFirst( bkey_, begin, end );
+    }
+
+    // a typed key: probe on both sides of where the model puts the start of the run.
+    long predicted, error;
+    if ( config_.model && end - begin > 1 && config_.model->predict( bkey_, predicted, error ) ) {
+        bool missed = false;
+        ++predictions_;
+        for ( long p : { predicted - error, predicted + error } ) {
+            if ( p <= begin || p >= end ) continue;
+
+            if ( (cpos = probeKey( p, bkey_, same )) < 0 ) {
+                logger_->error( "{} error code from probeKey.", fnname );
+                return -1;
+            }
+
+            // a hit is before the run, then in it.
+            if ( same ) {
+                missed = missed || p < predicted;
+                end = cpos;
+            } else {
+                missed = missed || p > predicted;
+                begin = p;
+            }
+        }
+        if ( !missed ) ++prediction_hits_;
+        logger_->trace( "{} model predicted {} for bkey={}: [{},{})", fnname, predicted, bkey_, begin, end );
+    }
+
+    // k-ary rounds while the probes are at least a page apart: the k-1 reads are started together.
+    long k = config_.kary;
+    while ( k > 2 && end - begin > k * PAGESIZE ) {
+        probes_.clear();
+        for ( long j = 1; j < k; ++j ) {
+            probes_.push_back( begin + (end - begin) * j / k );
+            input_->willNeed( probes_.back() - PAGESIZE, PAGESIZE + BUFSIZE );
+        }
 
-        bytes_read    = fread( buf, sizeof buf[0], block_size, source );
-        bytes_written = fwrite( buf, sizeof buf[0], bytes_read, dest );
-        total_bytes += bytes_written;
+        // the probes before the first record with our key have other keys; bisect the probes for that change.
+        size_t lo = 0, hi = probes_.size();
+        long nbegin = begin, nend = end;
+        while ( lo < hi ) {
+            size_t mid = lo + (hi - lo) / 2;
+            if ( (cpos = probeKey( probes_[mid], bkey_, same )) < 0 ) {
+                logger_->error( "{} error code from probeKey.", fnname );
+                return -1;
+            }
+
+            if ( same ) {
+                hi = mid;
+                nend = cpos;
+            } else {
+                lo = mid + 1;
+                nbegin = probes_[mid];
+            }
+        }
+
+        logger_->trace( "{} k-ary round: bkey={} [{},{}) -> [{},{})", fnname, bkey_, begin, end, nbegin, nend );
+        begin = nbegin;
+        end = nend;
+    }
+
+    soff = std::ceil( (begin + end) / 2.0);
+
+    // as intended, this loop will not be entered if we are searching anywhere in the first record.
+    while ( soff > begin && soff < end ) {
+
+        // compare the key fields in place; the probe's key is never copied.
+        if ( (cpos = probeKey( soff, bkey_, same )) < 0 ) {
+            logger_->error( "{} error code from probeKey.", fnname );
+            return -1;
+        }
+
+        if ( same ) {
+            // continue to jump toward beginning of file.
+            end = cpos;
+
+        } else {
+            // jump toward end of file.
+            begin = soff;
+        }
+
+        soff = std::ceil( (begin + end) / 2.0);
+        logger_->trace( "{} same={} bkey={} begin={} cpos={} end={} soff={}", fnname, same, bkey_, begin, cpos, end, soff );
+    }
+
+    // make sure we are at the beginning of the record
+    return setRecordStartOffset( soff );
+}
+
+bool BlockHandler::open( void )
+{
+    const static std::string fnname{"BH open"};
+
+    input_ = InputSource::create( config_.input, config_.mapmax, config_.cache );
+    if ( config_.input == InputSource::Kind::PREAD ) {
+        memo_.assign( MEMOSIZE, MemoEntry{ -1, std::string{} } );
+    }
+    if ( !input_->open( ifname_ ) ) {
+        logger_->error( "{} unable to open the input file: {}", fnname, ifname_ );
+        input_.reset();
+        return false;
+    }
+
+    if ( !copier_.open( ifname_ ) ) {
+        logger_->error( "{} Failed to open source file: {}", fnname, ifname_ );
+        input_.reset();
+        return false;
+    }
+
+    if ( config_.uring > 0 ) {
+        uring_.reset( new UringOutput{ config_.uring, copier_, logger_ } );
+        if ( !uring_->open( ifname_, ifsize_ ) ) {
+            logger_->warn( "{} io_uring output is not available; writing synchronously.", fnname );
+            uring_.reset();
+        }
+    }
+
+    return true;
+}
+
+void BlockHandler::close( void )
+{
+    const static std::string fnname{"BH close"};
+
+    if ( uring_ ) {
+        long redone = uring_->drain();
+        if ( redone > 0 ) logger_->warn( "{}: {} io_uring outputs were rewritten or failed.", fnname, redone );
+        uring_.reset();
+    }
+
+    if ( input_ && config_.stats ) {
+        input_->addStats( *config_.stats );
+        config_.stats->memo_hits += memo_hits_;
+        config_.stats->memo_misses += memo_misses_;
+        config_.stats->predictions += predictions_;
+        config_.stats->prediction_hits += prediction_hits_;
+    }
+    memo_hits_ = memo_misses_ = predictions_ = prediction_hits_ = 0;
+    memo_.clear();
+
+    copier_.close();
+    input_.reset();
+}
+
+long BlockHandler::findNextRun( long soff, long end )
+{
+    const static std::string fnname{"findNextRun"};
+    const char* rec;
+    long rlen, cpos, mid;
+    bool same;
+
+    if ( (rlen = recordView( soff, rec )) < 0 ) {
+        logger_->error( "{} unable to read the record at {}.", fnname, soff );
+        return -1;
+    }
+
+    scan::fields( rec, rlen, FileSplitter::fdelim, keylist_, fields_ );
+    scan::join( fields_, '.', bkey_ );
+
+    // the sidecar index brackets the run end between two of its entries; gallop from the last one in the run.
+    long from = soff;
+    if ( config_.index ) {
+        config_.index->narrowNext( bkey_, soff, from, end );
+    }
+
+    // lo is always inside a record with the run's key; hi is the start of a record with another key (or end).
+    long lo = from;
+    long hi = end;
+    bool gallop = true;
+
+    // a typed key: probe on both sides of where the model puts the end of the run; gallop only on a miss.  A run
+    // predicted to be shorter than the model's error is galloped, which is cheaper than bisecting the error bracket.
+    long predicted, error;
+    if ( config_.model && config_.model->predictEnd( bkey_, predicted, error ) && predicted - from > 2 * error ) {
+        bool missed = false;
+        ++predictions_;
+        for ( long p : { predicted - error, predicted + error } ) {
+            if ( p <= lo || p >= hi ) continue;
+
+            if ( (cpos = probeKey( p, bkey_, same )) < 0 ) return -1;
+
+            // a hit is in the run, then after it.
+            if ( same ) {
+                missed = missed || p > predicted;
+                lo = p;
+            } else {
+                missed = missed || p < predicted;
+                hi = cpos;
+            }
+        }
+        if ( !missed ) ++prediction_hits_;
+        gallop = missed;
+        logger_->trace( "{} model predicted {} for bkey={}: [{},{})", fnname, predicted, bkey_, lo, hi );
+    }
+
+    // gallop: double the stride, starting from one record, until the key changes.
+    for ( long base = lo, stride = rlen + 1; gallop && base + stride < hi; stride *= 2 ) {
+        if ( (cpos = probeKey( base + stride, bkey_, same )) < 0 ) return -1;
 
-        if ( bytes_written != bytes_read ) {
-            logger_->trace("{} write size: {} does not match the read size: {}.", fnname, bytes_written, bytes_read );
+        if ( !same ) {
+            hi = cpos;
             break;
         }
 
-        bytes_to_write -= bytes_read;
+        lo = base + stride;
+    }
+
+    // bisect only within the bracket the gallop found.
+    mid = lo + (hi - lo) / 2;
+    while ( mid > lo && mid < hi ) {
+        if ( (cpos = probeKey( mid, bkey_, same )) < 0 ) return -1;
+
+        if ( same ) {
+            lo = mid;
+        } else {
+            hi = cpos;
+        }
+
+        mid = lo + (hi - lo) / 2;
+        logger_->trace( "{} bkey={} lo={} cpos={} hi={} mid={}", fnname, bkey_, lo, cpos, hi, mid );
+    }
+
+    return hi;
+}
+
+long BlockHandler::scanNextRun( long soff, long end )
+{
+    const static std::string fnname{"scanNextRun"};
+    const char* rec;
+    long rlen;
+
+    if ( (rlen = recordView( soff, rec )) < 0 ) {
+        logger_->error( "{} unable to read the record at {}.", fnname, soff );
+        return -1;
+    }
+
+    scan::fields( rec, rlen, FileSplitter::fdelim, keylist_, fields_ );
+    scan::join( fields_, '.', bkey_ );
+
+    for ( long pos = soff + rlen + 1; pos < end; pos += rlen + 1 ) {
+        if ( (rlen = recordView( pos, rec )) < 0 ) {
+            logger_->error( "{} unable to read the record at {}.", fnname, pos );
+            return -1;
+        }
+
+        scan::fields( rec, rlen, FileSplitter::fdelim, keylist_, fields_ );
+        if ( !scan::equals( fields_, '.', bkey_ ) ) return pos;
+    }
+
+    return end;
+}
+
+long BlockHandler::recordLength( long rsoff )
+{
+    const char* rec;
+    long rlen = recordView( rsoff, rec );
+
+    if ( rlen < 0 ) return -1;
+    // count the record delimiter unless the file ends without one.
+    return ( rsoff + rlen < ifsize_ ) ? rlen + 1 : rlen;
+}
+
+bool BlockHandler::writeTask( const BlockTask& task )
+{
+    const static std::string fnname{"writeTask"};
+
+    if ( task.kind == BlockTask::Kind::CHUNK ) {
+        logger_->trace( "{}: writing chunk of key {}: [{},{}) at {}", fnname, task.key, task.begin, task.end, task.ooff );
+        if ( copier_.toFileAt( outputName( task.key ), task.ooff, task.begin, task.end - task.begin ) != task.end - task.begin ) {
+            logger_->error( "{}: failed to write chunk [{},{}) of key {}", fnname, task.begin, task.end, task.key );
+            return false;
+        }
+        return true;
+    }
+
+    logger_->trace( "{}: writing handed off run for key {}: [{},{})", fnname, task.key, task.begin, task.end );
+    return transfer( task.begin, task.end - task.begin, outputName( task.key ) ) >= 0;
+}
+
+long BlockHandler::resolveBoundary( long i )
+{
+    const static std::string fnname{"resolveBoundary"};
+    long off, noff, cpos;
+    std::string nkey;
+
+    if ( !boundaries_->claim( i ) ) return boundaries_->wait( i );
+
+    long b = boundaries_->proposed( i );
+    long lower = 0;
+
+    // a neighbor with the same key is in the same run, and so is everything between them.
+    for ( long n : { i - 1, i + 1 } ) {
+        if ( !boundaries_->peek( n, noff, nkey ) ) continue;
+
+        bool same;
+        if ( (cpos = probeKey( b, nkey, same )) < 0 ) {
+            logger_->error( "{} unable to read the record at {}.", fnname, b );
+            boundaries_->publish( i, BoundaryTable::FAILED, std::string{}, true );
+            return -1;
+        }
+
+        if ( same ) {
+            logger_->trace( "{} boundary {} at {} is in the run of boundary {} at {}.", fnname, i, b, n, noff );
+            bkey_ = nkey;
+            boundaries_->publish( i, noff, nkey, false );
+            return noff;
+        }
+
+        // the previous proposed offset is in a run with another key.
+        if ( n < i ) lower = boundaries_->proposed( n );
+    }
+
+    off = findFirstRecord( b, b, lower );
+    boundaries_->publish( i, ( off < 0 ) ? BoundaryTable::FAILED : off, bkey_, true );
+    return off;
+}
+
+void BlockHandler::operator()( Scheduler& scheduler, unsigned worker, Pipeline* pipeline, BoundaryTable* boundaries )
+{
+    const static std::string fnname{"BH Worker"};
+
+    BlockTask task;
+
+    if ( !open() ) return;
+
+    scheduler_ = &scheduler;
+    worker_ = worker;
+    pipeline_ = pipeline;
+    boundaries_ = boundaries;
+
+    while ( scheduler.next( worker, task ) ) {
+        if ( task.kind == BlockTask::Kind::BLOCK ) {
+            (*this)( task.begin, task.end, task.search );
+        } else {
+            writeTask( task );
+        }
+        scheduler.done();
+    }
+
+    scheduler_ = nullptr;
+    pipeline_ = nullptr;
+    boundaries_ = nullptr;
+    close();
+}
+
+void BlockHandler::operator()( Pipeline& pipeline )
+{
+    const static std::string fnname{"BH Writer"};
+
+    BlockTask task;
+
+    // keep draining even when the input cannot be opened, so the search workers are never blocked on a full queue.
+    bool ok = open();
+    if ( !ok ) {
+        logger_->error( "{}: unable to open the input; the runs given to this writer are lost.", fnname );
+    }
+
+    while ( pipeline.next( task ) ) {
+        if ( ok ) writeTask( task );
+    }
+
+    if ( ok ) close();
+}
+
+void BlockHandler::operator()( long begin, long end )
+{
+    (*this)( begin, end, config_.search == SearchStrategy::AUTO ? SearchStrategy::GALLOP : config_.search );
+}
+
+void BlockHandler::operator()( long begin, long end, SearchStrategy search )
+{
+    const static std::string fnname{"BH Runner"};
+
+    std::string fn{ odname_ };
+
+    if ( !input_ && !open() ) return;
+
+    logger_->trace( "{} block original bounds [{},{})", fnname, begin, end );
+
+    // with the shared table each boundary is searched for once, by one of the two blocks that share it.
+    long bi = boundaries_ ? boundaries_->index( begin ) : -1;
+    if ( bi >= 0 ) {
+        if ( (begin = resolveBoundary( bi )) < 0 || (end = resolveBoundary( bi + 1 )) < 0 ) {
+            return;
+        }
+        logger_->trace( "{}: block resolved bounds [{},{}).", fnname, begin, end );
+    } else if ( (begin = findFirstRecord( begin, end )) < 0 ) {
+        return;
+    }
+
+    logger_->trace( "{} block new start: {} with key: {}.", fnname, begin, bkey_ );
+
+    fn += bkey_;
+
+    if ( bi >= 0 ) {
+        // already resolved.
+    } else if ( end >= ifsize_ ) end = ifsize_;
+    else {
+        // search for the first record starting on the last line.
+        if ( (end = findFirstRecord( end, end )) < 0 ) {
+            return;
+        }
+    }
+
+    logger_->trace( "{}: block new end: {} with key: {}.", fnname, end, bkey_ );
+
+    fn += "-" + bkey_ + ".csv";
+
+    if ( begin == end ) {
+        logger_->trace( "{}: homogeonous key, so empty block.", fnname );
+    }
+
+    long total_bytes = end - begin;
+    logger_->trace( "{}: Total Bytes to Write: {}.", fnname, total_bytes );
+
+    // for testing, just write the entire block at key boundaries for this block.
+    // transfer( begin, end - begin, fn ); 
+
+    if ( search == SearchStrategy::STREAM ) {
+        // every record will be read in order.
+        input_->willScan( begin, end - begin );
+    }
+
+    if ( search == SearchStrategy::GALLOP || search == SearchStrategy::STREAM ) {
+        // move from front to back: gallop (or scan) forward from each run start to the next one, so the cost of each
+        // search depends on the length of the run and the runs are written in file order.
+        while ( begin < end ) {
+            long next = ( search == SearchStrategy::STREAM ) ? scanNextRun( begin, end ) : findNextRun( begin, end );
+            if ( next < 0 ) return;
+            long r = writeRun( bkey_, begin, next - begin );
+            logger_->trace( "{}: begin: {} next: {} end: {}", fnname, begin, next, end);
+            logger_->trace( "{}: Attempting to write: {}; Wrote {} bytes for key {}", fnname, next-begin, r, bkey_ );
+            total_bytes -= r;
+            begin = next;
+        }
+    }
+
+    // move from back to front now that we have our boundaries and write out each block.
+    // the search is a binary search (logarithmic time).
+    while ( end > begin ) {
+        // end - 1 moves into the last byte of the block of interest or begin = end - 1 which will halt execution.
+        long epos = findFirstRecord( end - 1, end );
+        long r = writeRun( bkey_, epos, end - epos );
+        logger_->trace( "{}: begin: {} epos: {} end: {}", fnname, begin, epos, end);
+        logger_->trace( "{}: Attempting to write: {}; Wrote {} bytes for key {}", fnname, end-epos, r, bkey_ );
+        total_bytes -= r;
+        end = epos;
+    }
+
+    logger_->trace( "{}: Output Bytes Status: {}.", fnname, total_bytes );
+}
+
+long BlockHandler::writeChunked( const std::string& key, long soff, long len )
+{
+    const static std::string fnname{"writeChunked"};
+
+    std::string ofn = outputName( key );
+    long hlen = header_.length();
+    long chunk = config_.chunk;
+
+    // the file gets its header and its final size now; the chunks then land at fixed offsets in any order.
+    if ( !copier_.prepare( ofn, header_, len ) ) {
+        return -1;
+    }
+
+    long nchunks = (len + chunk - 1) / chunk;
+    logger_->debug( "{}: copying key {} ({} bytes) in {} chunks.", fnname, key, len, nchunks );
+
+    // with the write workers on, all of the chunks go to them.
+    if ( pipeline_ ) {
+        for ( long i = 0; i < nchunks; ++i ) {
+            long b = soff + i * chunk;
+            long e = ( b + chunk < soff + len ) ? b + chunk : soff + len;
+            pipeline_->push( BlockTask{ BlockTask::Kind::CHUNK, b, e, key, hlen + i * chunk, SearchStrategy::AUTO } );
+        }
+        return len;
+    }
+
+    // push the later chunks from the back so this worker keeps going forward while the others steal.
+    for ( long i = nchunks - 1; i > 0; --i ) {
+        long b = soff + i * chunk;
+        long e = ( b + chunk < soff + len ) ? b + chunk : soff + len;
+        scheduler_->push( worker_, BlockTask{ BlockTask::Kind::CHUNK, b, e, key, hlen + i * chunk, SearchStrategy::AUTO } );
+    }
+
+    long r = copier_.toFileAt( ofn, hlen, soff, chunk );
+    if ( r != chunk ) {
+        logger_->error( "{}: failed to write the first chunk of key {}", fnname, key );
+        return -1;
+    }
+
+    return len;
+}
+
+long BlockHandler::writeParts( const std::string& key, long soff, long len )
+{
+    const static std::string fnname{"writeParts"};
+
+    long end = soff + len;
+    long cap = config_.maxpart - static_cast<long>( header_.length() );    // every part starts with the header.
+    std::vector<long> cuts{ soff };
+
+    for ( long p = soff; p < end; ) {
+        long next = p + cap;
+        if ( next >= end ) {
+            next = end;
+        } else {
+            // the record holding the byte at the cap starts the next part; a record longer than the cap is a part alone.
+            long r = setRecordStartOffset( next );
+            if ( r < 0 ) return -1;
+            if ( r <= p ) {
+                if ( (r = recordLength( p )) <= 0 ) return -1;
+                r += p;
+                logger_->warn( "{}: the record of key {} at {} is {} bytes; its part is larger than the maximum output size.", fnname, key, p, r - p );
+            }
+            next = r;
+        }
+        cuts.push_back( next );
+        p = next;
+    }
+
+    long nparts = cuts.size() - 1;
+    std::vector<std::string> names;
+    for ( long i = 0; i < nparts; ++i ) {
+        char part[32];
+        std::snprintf( part, sizeof part, ".part-%04ld", i );
+        names.push_back( key + part );
+    }
+
+    logger_->debug( "{}: writing key {} ({} bytes) in {} parts.", fnname, key, len, nparts );
+
+    // with the write workers on, all of the parts go to them.
+    if ( pipeline_ ) {
+        for ( long i = 0; i < nparts; ++i ) {
+            pipeline_->push( BlockTask{ BlockTask::Kind::RUN, cuts[i], cuts[i+1], names[i], 0, SearchStrategy::AUTO } );
+        }
+        return len;
+    }
+
+    // push the later parts from the back so this worker keeps going forward while the others steal.
+    long first = nparts;
+    if ( scheduler_ ) {
+        for ( ; first > 1; --first ) {
+            scheduler_->push( worker_, BlockTask{ BlockTask::Kind::RUN, cuts[first-1], cuts[first], names[first-1], 0, SearchStrategy::AUTO } );
+        }
+    }
+
+    for ( long i = 0; i < first; ++i ) {
+        if ( transfer( cuts[i], cuts[i+1] - cuts[i], outputName( names[i] ) ) != cuts[i+1] - cuts[i] ) {
+            logger_->error( "{}: failed to write part {} of key {}", fnname, i, key );
+            return -1;
+        }
+    }
+
+    return len;
+}
+
+std::string BlockHandler::outputName( const std::string& key ) const
+{
+    return odname_ + key + ".csv";
+}
+
+long BlockHandler::writeRun( const std::string& key, long soff, long len )
+{
+    // plan mode: record where the run is; nothing is copied.
+    if ( config_.manifest ) {
+        config_.manifest->add( worker_, key, soff, len );
+        return len;
+    }
+
+    // a run whose output (with the header) is larger than the maximum output size is written in parts.
+    if ( config_.maxpart > 0 && len + static_cast<long>( header_.length() ) > config_.maxpart ) {
+        return writeParts( key, soff, len );
+    }
+
+    // a very large run is copied in chunks by all of the workers.
+    if ( scheduler_ && config_.chunk > 0 && len > config_.chunk ) {
+        return writeChunked( key, soff, len );
+    }
+
+    // the write workers copy every run.
+    if ( pipeline_ ) {
+        pipeline_->push( BlockTask{ BlockTask::Kind::RUN, soff, soff + len, key, 0, SearchStrategy::AUTO } );
+        return len;
+    }
+
+    // somebody is out of work: let them copy this run while we keep searching.
+    if ( scheduler_ && scheduler_->hungry() ) {
+        scheduler_->push( worker_, BlockTask{ BlockTask::Kind::RUN, soff, soff + len, key, 0, SearchStrategy::AUTO } );
+        return len;
+    }
+
+    return transfer( soff, len, outputName( key ) );
+}
+
+long BlockHandler::transfer( long soff, long bytes_to_write, const std::string& ofn )
+{
+    const static std::string fnname{"transfer"};
+
+    long total_bytes = uring_ ? uring_->submit( ofn, header_, soff, bytes_to_write ) : copier_.toFile( ofn, header_, soff, bytes_to_write );
+
+    if ( total_bytes < 0 ) {
+        logger_->error( "{} failed to write {} bytes at {} to: {}", fnname, bytes_to_write, soff, ofn );
+    } else if ( total_bytes != bytes_to_write ) {
+        logger_->trace( "{} write size: {} does not match the requested size: {}.", fnname, total_bytes, bytes_to_write );
     }
 
-    fclose( source );
-    fclose( dest );
     return total_bytes;
 }
 
 int main( int argc, char* argv[] )
 {
-    FileSplitter fs{"filesplitter","  Split single large CSV files into individual files having unique keys.\n  Individual files are named based on their unique keys.\n  Keys can be made up of multiple fields/columns in the CSV file.\n  Splitting is made more efficient in two ways:\n    1. Multiple threads can be used.\n    2. Binary search is done to find the break points.\n    3. All operations on at the byte-level, not the line level.\n  CAUTION: The large file must be sorted by the key used to split."};
+    FileSplitter fs{"filesplitter","  Split single large CSV files into individual files having unique keys.\n  Individual files are named based on their unique keys.\n  Keys can be made up of multiple fields/columns in the CSV file.\n  Splitting is made more efficient in two ways:\n    1. Multiple threads can be used.\n    2. Binary search is done to find the break points.\n    3. All operations on at the byte-level, not the line level.\n  CAUTION: The large file must be sorted by the key used to split (or use -U).\n  Commands:\n    filesplitter [options] file          split the file; - (stdin) or a FIFO is split in one streaming pass.\n    filesplitter index [options] file    build the sidecar key index (-I) of the file for the key (-k).\n    filesplitter plan [options] file     only find the key runs and write their offsets to a manifest (-m).\n    filesplitter extract [options] file key [last]\n                                         write the records of key, or of the keys from key to last, to stdout (or -O).\n    filesplitter lookup [options] file keyfile\n                                         write the records of each key in keyfile (one per line) to its own file, or to\n                                         one framed stream with -O (- is stdout)."};
     fs.addOption( 'h', "help", "print out some help" );
     fs.addOption( 'H', "header", "The first line in the file is a header line." );
     fs.addOption( 't', "threads", "The number of threads to use to process the file.", true );
+    fs.addOption( 'w', "writers", "The number of write threads; the -t threads then only search and queue the key runs for them (default 0 = off)", true );
+    fs.addOption( 'r', "ranges", "The number of byte ranges per thread the file is cut into; idle threads steal ranges (default 16)", true );
     fs.addOption( 'v', "verbose", "The log level [trace,debug,info,warning,error,critical,off]", true );
     fs.addOption( 'o', "outdir", "The directory in which to put the output", true, "output" );
     fs.addOption( 'L', "logdir", "The directory in which to put the logs", true );
     fs.addOption( 'k', "key", "The data field indices (1-based column numbers) used to define the key to split the files", true );
+    fs.addOption( 'i', "input", "The input backend used for the searches [mmap,pread,stdio]; non-regular files always use stdio", true, "mmap" );
+    fs.addOption( 'c', "cache", "The per-thread probe cache (MB) of the pread input backend (default 4)", true );
+    fs.addOption( 'M', "mapmax", "The largest piece of the input (MB) mapped at once; larger files are mapped in windows", true );
+    fs.addOption( 's', "search", "How the key runs in a block are enumerated [auto,gallop,bisect,stream]; auto samples the keys to choose per range", true, "auto" );
+    fs.addOption( 'p', "samples", "The number of random records sampled to plan the auto search (default 1024)", true );
+    fs.addOption( 'q', "inflight", "Resolve the block boundaries first with this many interleaved searches in flight (needs FILESPLITTER_COROUTINES; default 0 = off)", true );
+    fs.addOption( 'K', "kary", "Search each boundary with k-1 probe reads in flight per round (k-ary search; default 0 = bisection)", true );
+    fs.addOption( 'T', "keytype", "The type of the (single field) key [string,int,decimal,time]; typed keys are searched with a learned model of their offsets", true );
+    fs.addOption( 'I', "index", "Narrow the searches with the input's sidecar key index, building it (one entry per this many KB) when missing or stale", true );
+    fs.addOption( 'm', "manifest", "The manifest file written by the plan command (default <outdir>/manifest.fsm); extract looks the keys up in it instead of searching", true );
+    fs.addOption( 'f', "format", "Extra views of the manifest written next to it [csv,json]", true );
+    fs.addOption( 'O', "output", "The file the extract command (default stdout) or the lookup command's framed stream (- is stdout) is written to", true );
+    fs.addOption( 'U', "unsorted", "The input is not sorted by key: scatter every record to its key's file (the order of a key's records is not kept)" );
+    fs.addOption( 'P', "partitions", "Write N outputs (part-00000.csv, ...) instead of one per key; each key goes to the one its hash picks (the input need not be sorted)", true );
+    fs.addOption( 'S', "shards", "Write N outputs (shard-00000.csv, ...) of about the same size from the sorted input, cut only between keys", true );
+    fs.addOption( 'F', "files", "The most outputs the unsorted split keeps open at once (default: the open file limit)", true );
+    fs.addOption( 'n', "count", "Count the records of each key run in the manifest (reads the whole input)" );
+    fs.addOption( 'C', "chunk", "Key runs larger than this (MB) are copied in chunks of this size by all threads (default 64; 0 = off)", true );
+    fs.addOption( 'z', "maxsize", "Key runs larger than this (MB) are written as key.part-0000.csv, key.part-0001.csv, ... of at most this size (default 0 = off)", true );
+    fs.addOption( 'u', "uring", "Write the outputs through io_uring with this many in flight per thread (default 0 = off)", true );
+    fs.addOption( 'x', "transfer", "The first copy method to try [auto,copy_file_range,sendfile,splice,readwrite]", true, "auto" );
 
     try {
 
@@ -598,6 +1983,6 @@ int main( int argc, char* argv[] )
     }
 
     // run the file splitter and exit with the tool's return code.
-    std::exit( fs.splitFile() );
+    std::exit( fs() );
 }
 
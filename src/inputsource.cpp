@@ -0,0 +1,381 @@
+#include "inputsource.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+InputSource::Ptr InputSource::create( Kind kind, long mapmax, long cachemax )
+{
+#ifndef _MSC_VER
+    if ( kind == Kind::MMAP ) {
+        return Ptr{ new MappedSource{ mapmax } };
+    }
+    if ( kind == Kind::PREAD ) {
+        return Ptr{ new CachedSource{ cachemax } };
+    }
+#endif
+    return Ptr{ new StdioSource{} };
+}
+
+InputSource::InputSource( void ) :
+    size_{ 0 }
+{
+}
+
+InputSource::~InputSource( void )
+{
+}
+
+void InputSource::willScan( long, long )
+{
+}
+
+void InputSource::willNeed( long, long )
+{
+}
+
+void InputSource::addStats( ProbeStats& ) const
+{
+}
+
+long InputSource::size( void ) const
+{
+    return size_;
+}
+
+StdioSource::StdioSource( void ) :
+    InputSource{},
+    f_{ nullptr },
+    buf_( 8 * 1024 ),
+    boff_{ 0 },
+    blen_{ 0 }
+{
+}
+
+StdioSource::~StdioSource( void )
+{
+    close();
+}
+
+bool StdioSource::open( const std::string& fn )
+{
+    struct stat finfo;
+
+    close();
+
+    f_ = fopen( fn.c_str(), "rb" );
+    if ( !f_ || fstat( fileno(f_), &finfo ) != 0 ) {
+        close();
+        return false;
+    }
+
+    size_ = finfo.st_size;
+    return true;
+}
+
+void StdioSource::close( void )
+{
+    if ( f_ ) fclose( f_ );
+    f_ = nullptr;
+    size_ = 0;
+    boff_ = 0;
+    blen_ = 0;
+}
+
+void StdioSource::willNeed( long off, long len )
+{
+#ifndef _MSC_VER
+    if ( !f_ ) return;
+    if ( off < 0 ) off = 0;
+    posix_fadvise( fileno( f_ ), off, len, POSIX_FADV_WILLNEED );
+#endif
+}
+
+const char* StdioSource::view( long off, long len )
+{
+    if ( !f_ || off < 0 || off >= size_ ) return nullptr;
+
+    if ( len > size_ - off ) len = size_ - off;
+
+    // already buffered.
+    if ( off >= boff_ && off + len <= boff_ + blen_ ) {
+        return buf_.data() + (off - boff_);
+    }
+
+    if ( static_cast<long>(buf_.size()) < len ) buf_.resize( len );
+
+    // read as much as the buffer holds so neighboring views can be served without another seek.
+    long rlen = static_cast<long>(buf_.size());
+    if ( rlen > size_ - off ) rlen = size_ - off;
+
+    if ( fseek( f_, off, SEEK_SET ) != 0 ) {
+        blen_ = 0;
+        return nullptr;
+    }
+
+    boff_ = off;
+    blen_ = fread( buf_.data(), sizeof buf_[0], rlen, f_ );
+    if ( blen_ < len ) return nullptr;
+
+    return buf_.data();
+}
+
+#ifndef _MSC_VER
+
+MappedSource::MappedSource( long mapmax ) :
+    InputSource{},
+    fd_{ -1 },
+    mapmax_{ mapmax },
+    pagesize_{ sysconf( _SC_PAGESIZE ) },
+    base_{ nullptr },
+    moff_{ 0 },
+    mlen_{ 0 }
+{
+    // the window must hold at least a page.
+    if ( mapmax_ < pagesize_ ) mapmax_ = pagesize_;
+}
+
+MappedSource::~MappedSource( void )
+{
+    close();
+}
+
+bool MappedSource::open( const std::string& fn )
+{
+    struct stat finfo;
+
+    close();
+
+    fd_ = ::open( fn.c_str(), O_RDONLY );
+    if ( fd_ < 0 || fstat( fd_, &finfo ) != 0 || !S_ISREG( finfo.st_mode ) ) {
+        close();
+        return false;
+    }
+
+    size_ = finfo.st_size;
+
+    // small enough to map in one piece; otherwise windows are mapped on demand.
+    if ( size_ > 0 && size_ <= mapmax_ ) {
+        return remap( 0, size_ );
+    }
+
+    return true;
+}
+
+void MappedSource::close( void )
+{
+    if ( base_ ) munmap( base_, mlen_ );
+    if ( fd_ >= 0 ) ::close( fd_ );
+    fd_ = -1;
+    base_ = nullptr;
+    size_ = 0;
+    moff_ = 0;
+    mlen_ = 0;
+}
+
+bool MappedSource::remap( long off, long len )
+{
+    if ( base_ ) munmap( base_, mlen_ );
+    base_ = nullptr;
+
+    // mappings must start on a page boundary.
+    moff_ = off - (off % pagesize_);
+    mlen_ = (off - moff_) + len;
+    if ( mlen_ < mapmax_ ) mlen_ = mapmax_;
+    if ( mlen_ > size_ - moff_ ) mlen_ = size_ - moff_;
+
+    void* p = mmap( nullptr, mlen_, PROT_READ, MAP_PRIVATE, fd_, moff_ );
+    if ( p == MAP_FAILED ) {
+        mlen_ = 0;
+        return false;
+    }
+
+    // the search probes jump all over the file; read-ahead would only waste I/O.
+    madvise( p, mlen_, MADV_RANDOM );
+    base_ = static_cast<char*>( p );
+    return true;
+}
+
+void MappedSource::willScan( long off, long len )
+{
+    // only the part of the range that is mapped right now can be advised.
+    if ( !base_ ) return;
+
+    long b = ( off > moff_ ) ? off : moff_;
+    long e = ( off + len < moff_ + mlen_ ) ? off + len : moff_ + mlen_;
+    if ( e <= b ) return;
+
+    b -= (b - moff_) % pagesize_;
+    madvise( base_ + (b - moff_), e - b, MADV_SEQUENTIAL );
+    madvise( base_ + (b - moff_), e - b, MADV_WILLNEED );
+}
+
+void MappedSource::willNeed( long off, long len )
+{
+    if ( !base_ ) {
+        posix_fadvise( fd_, off < 0 ? 0 : off, len, POSIX_FADV_WILLNEED );
+        return;
+    }
+
+    long b = ( off > moff_ ) ? off : moff_;
+    long e = ( off + len < moff_ + mlen_ ) ? off + len : moff_ + mlen_;
+
+    if ( e <= b ) {
+        // outside of the current window: get it into the page cache for the next remap.
+        posix_fadvise( fd_, off < 0 ? 0 : off, len, POSIX_FADV_WILLNEED );
+        return;
+    }
+
+    b -= (b - moff_) % pagesize_;
+    madvise( base_ + (b - moff_), e - b, MADV_WILLNEED );
+}
+
+const char* MappedSource::view( long off, long len )
+{
+    if ( fd_ < 0 || off < 0 || off >= size_ ) return nullptr;
+
+    if ( len > size_ - off ) len = size_ - off;
+
+    if ( !base_ || off < moff_ || off + len > moff_ + mlen_ ) {
+        if ( !remap( off, len ) ) return nullptr;
+    }
+
+    return base_ + (off - moff_);
+}
+
+CachedSource::CachedSource( long cachemax ) :
+    InputSource{},
+    fd_{ -1 },
+    capacity_{ static_cast<size_t>( cachemax / BLOCK > 2 ? cachemax / BLOCK : 2 ) },
+    lru_{},
+    blocks_{},
+    scratch_{},
+    hits_{ 0 },
+    misses_{ 0 },
+    evictions_{ 0 }
+{
+}
+
+CachedSource::~CachedSource( void )
+{
+    close();
+}
+
+bool CachedSource::open( const std::string& fn )
+{
+    struct stat finfo;
+
+    close();
+
+    fd_ = ::open( fn.c_str(), O_RDONLY );
+    if ( fd_ < 0 || fstat( fd_, &finfo ) != 0 || !S_ISREG( finfo.st_mode ) ) {
+        close();
+        return false;
+    }
+
+    size_ = finfo.st_size;
+    return true;
+}
+
+void CachedSource::close( void )
+{
+    if ( fd_ >= 0 ) ::close( fd_ );
+    fd_ = -1;
+    size_ = 0;
+    lru_.clear();
+    blocks_.clear();
+}
+
+const CachedSource::Block* CachedSource::fetch( long index )
+{
+    auto it = blocks_.find( index );
+    if ( it != blocks_.end() ) {
+        ++hits_;
+        lru_.splice( lru_.begin(), lru_, it->second );
+        return &lru_.front();
+    }
+
+    ++misses_;
+
+    // reuse the least recently used block's buffer when the cache is full.
+    if ( lru_.size() >= capacity_ ) {
+        ++evictions_;
+        blocks_.erase( lru_.back().index );
+        lru_.splice( lru_.begin(), lru_, std::prev( lru_.end() ) );
+    } else {
+        lru_.push_front( Block{ 0, 0, std::vector<char>( BLOCK ) } );
+    }
+
+    Block& b = lru_.front();
+    b.index = index;
+    b.len = 0;
+
+    long off = index * BLOCK;
+    long want = ( BLOCK < size_ - off ) ? BLOCK : size_ - off;
+    while ( b.len < want ) {
+        ssize_t n = pread( fd_, b.data.data() + b.len, want - b.len, off + b.len );
+        if ( n < 0 && errno == EINTR ) continue;
+        if ( n <= 0 ) {
+            lru_.pop_front();
+            return nullptr;
+        }
+        b.len += n;
+    }
+
+    blocks_[ index ] = lru_.begin();
+    return &b;
+}
+
+const char* CachedSource::view( long off, long len )
+{
+    if ( fd_ < 0 || off < 0 || off >= size_ ) return nullptr;
+
+    if ( len > size_ - off ) len = size_ - off;
+
+    const Block* b = fetch( off / BLOCK );
+    if ( !b ) return nullptr;
+
+    long boff = off % BLOCK;
+    if ( boff + len <= b->len ) {
+        return b->data.data() + boff;
+    }
+
+    // the view crosses into the next blocks: copy the pieces together.
+    if ( static_cast<long>( scratch_.size() ) < len ) scratch_.resize( len );
+
+    long copied = 0;
+    while ( copied < len ) {
+        long n = b->len - boff;
+        if ( n > len - copied ) n = len - copied;
+        std::memcpy( scratch_.data() + copied, b->data.data() + boff, n );
+        copied += n;
+        if ( copied < len && (b = fetch( (off + copied) / BLOCK )) == nullptr ) return nullptr;
+        boff = 0;
+    }
+
+    return scratch_.data();
+}
+
+void CachedSource::willNeed( long off, long len )
+{
+    if ( fd_ < 0 ) return;
+    posix_fadvise( fd_, off < 0 ? 0 : off, len, POSIX_FADV_WILLNEED );
+}
+
+void CachedSource::addStats( ProbeStats& stats ) const
+{
+    stats.hits += hits_;
+    stats.misses += misses_;
+    stats.evictions += evictions_;
+}
+
+#endif
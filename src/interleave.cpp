@@ -0,0 +1,307 @@
+#include "interleave.hpp"
+#include "filesplitter.hpp"
+#include "scan.hpp"
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+InterleavedSearch::InterleavedSearch( unsigned inflight, const std::vector<uint32_t>& keylist, LogPtr logger ) :
+    inflight_{ inflight > 0 ? inflight : 1 },
+    keylist_{ keylist },
+    logger_{ logger },
+    fd_{ -1 },
+    ifsize_{ 0 },
+    hlen_{ 0 },
+    nowait_{ false },
+    waiting_{},
+    probes_{ 0 },
+    misses_{ 0 },
+    blocking_{ 0 }
+{
+}
+
+InterleavedSearch::~InterleavedSearch( void )
+{
+    close();
+}
+
+bool InterleavedSearch::open( const std::string& ifname, long ifsize, long hlen )
+{
+    close();
+    ifsize_ = ifsize;
+    hlen_ = hlen;
+#ifdef RWF_NOWAIT
+    nowait_ = true;
+#endif
+    fd_ = ::open( ifname.c_str(), O_RDONLY );
+    return fd_ >= 0;
+}
+
+void InterleavedSearch::close( void )
+{
+    if ( fd_ >= 0 ) ::close( fd_ );
+    fd_ = -1;
+}
+
+#ifdef FILESPLITTER_COROUTINES
+
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <thread>
+
+/**
+ * @brief The coroutine of one boundary search; it starts suspended and is resumed by resolve.
+ */
+struct InterleavedSearch::Task {
+    struct promise_type {
+        Task get_return_object( void ) { return Task{ std::coroutine_handle<promise_type>::from_promise( *this ) }; }
+        std::suspend_always initial_suspend( void ) noexcept { return {}; }
+        std::suspend_always final_suspend( void ) noexcept { return {}; }
+        void return_void( void ) {}
+        void unhandled_exception( void ) { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+/**
+ * @brief Awaitable read of the record that contains the byte at offset.
+ *
+ * When it completes, rstart is the start of the record and rec/rlen is the record without its delimiter.
+ */
+struct InterleavedSearch::Probe {
+    InterleavedSearch& engine;
+    long offset;
+    long wlo;                                                   ///> the window [wlo, whi) read from the file.
+    long whi;
+    std::vector<char> buf;
+    long rstart;
+    const char* rec;
+    long rlen;
+    int misses;
+    bool failed;
+    std::coroutine_handle<> waiter;
+
+    Probe( InterleavedSearch& e, long off ) :
+        engine{ e }, offset{ off }, wlo{ 0 }, whi{ 0 }, buf{}, rstart{ 0 }, rec{ nullptr }, rlen{ 0 }, misses{ 0 }, failed{ false }, waiter{}
+    {
+        wlo = offset - WINDOW / 2;
+        wlo -= wlo % 4096;
+        if ( wlo < 0 ) wlo = 0;
+        whi = ( offset + WINDOW / 2 < engine.ifsize_ ) ? offset + WINDOW / 2 : engine.ifsize_;
+    }
+
+    bool await_ready( void ) { return engine.attempt( *this, false ); }
+    void await_suspend( std::coroutine_handle<> h ) { waiter = h; engine.waiting_.push_back( this ); }
+    bool await_resume( void ) { return !failed; }
+};
+
+bool InterleavedSearch::available( void )
+{
+    return true;
+}
+
+bool InterleavedSearch::attempt( Probe& p, bool block )
+{
+    // same bounds as BlockHandler::setRecordStartOffset: the byte at the offset does not count, nor does the header.
+    long lo = hlen_ + 1;
+    long off = ( p.offset < ifsize_ ) ? p.offset : ifsize_ - 1;
+
+    while ( true ) {
+        long len = p.whi - p.wlo;
+        ssize_t n = -1;
+
+        p.buf.resize( len );
+#ifdef RWF_NOWAIT
+        if ( nowait_ && !block ) {
+            struct iovec iov{ p.buf.data(), static_cast<size_t>( len ) };
+            n = preadv2( fd_, &iov, 1, p.wlo, RWF_NOWAIT );
+            if ( n < 0 && errno != EAGAIN ) {
+                // the file system cannot do it: block from now on.
+                if ( errno == EOPNOTSUPP || errno == EINVAL ) nowait_ = false;
+                return attempt( p, true );
+            }
+
+            if ( n < len ) {
+                // not (all) in the page cache: start reading it and come back later.
+                if ( p.misses++ == 0 ) ++misses_;
+                posix_fadvise( fd_, p.wlo, len, POSIX_FADV_WILLNEED );
+                return false;
+            }
+        } else
+#endif
+        {
+            if ( p.misses > 0 ) ++blocking_;
+            long got = 0;
+            while ( got < len ) {
+                n = pread( fd_, p.buf.data() + got, len - got, p.wlo + got );
+                if ( n < 0 && errno == EINTR ) continue;
+                if ( n <= 0 ) break;
+                got += n;
+            }
+            if ( got < len ) {
+                logger_->error( "InterleavedSearch::attempt unable to read {} bytes at {}: {}", len, p.wlo, std::strerror( errno ) );
+                p.failed = true;
+                return true;
+            }
+        }
+
+        ++probes_;
+        const char* base = p.buf.data();
+
+        // the start of the record: the byte after the last delimiter before the offset.
+        long from = ( p.wlo > lo ) ? p.wlo : lo;
+        const char* q = ( off > from ) ? scan::findLast( base + (from - p.wlo), off - from, FileSplitter::rdelim ) : nullptr;
+        if ( q == nullptr && p.wlo >= lo && off > lo ) {
+            p.wlo = ( p.wlo - len > 0 ) ? p.wlo - len : 0;
+            continue;
+        }
+        p.rstart = q ? p.wlo + (q - base) + 1 : ( off < lo ? off : lo - 1 );
+
+        // the end of the record: the delimiter at or after its start.
+        const char* e = static_cast<const char*>( std::memchr( base + (p.rstart - p.wlo), FileSplitter::rdelim, p.whi - p.rstart ) );
+        if ( e == nullptr && p.whi < ifsize_ ) {
+            p.whi = ( p.whi + len < ifsize_ ) ? p.whi + len : ifsize_;
+            continue;
+        }
+
+        p.rec = base + (p.rstart - p.wlo);
+        p.rlen = e ? e - p.rec : p.whi - p.rstart;
+        return true;
+    }
+}
+
+InterleavedSearch::Task InterleavedSearch::search( BoundaryTable& table, long i )
+{
+    std::vector<scan::Span> fields;
+    std::string key, nkey;
+    long noff;
+
+    Probe first{ *this, table.proposed( i ) };
+    if ( !co_await first ) {
+        table.publish( i, BoundaryTable::FAILED, std::string{}, true );
+        co_return;
+    }
+
+    scan::fields( first.rec, first.rlen, FileSplitter::fdelim, keylist_, fields );
+    scan::join( fields, '.', key );
+
+    // a published neighbor with the same key is in the same run.
+    long begin = hlen_;
+    for ( long n : { i - 1, i + 1 } ) {
+        if ( !table.peek( n, noff, nkey ) ) continue;
+        if ( nkey == key ) {
+            table.publish( i, noff, key, false );
+            co_return;
+        }
+        if ( n < i && table.proposed( n ) > begin ) begin = table.proposed( n );
+    }
+
+    // the bisection of BlockHandler::findFirstRecord, one suspended probe at a time.
+    long end = first.rstart;
+    long soff = std::ceil( (begin + end) / 2.0 );
+    while ( soff > begin && soff < end ) {
+        Probe p{ *this, soff };
+        if ( !co_await p ) {
+            table.publish( i, BoundaryTable::FAILED, std::string{}, true );
+            co_return;
+        }
+
+        scan::fields( p.rec, p.rlen, FileSplitter::fdelim, keylist_, fields );
+        if ( scan::equals( fields, '.', key ) ) {
+            end = p.rstart;
+        } else {
+            begin = soff;
+        }
+        soff = std::ceil( (begin + end) / 2.0 );
+    }
+
+    if ( soff != end ) {
+        Probe last{ *this, soff };
+        if ( !co_await last ) {
+            table.publish( i, BoundaryTable::FAILED, std::string{}, true );
+            co_return;
+        }
+        soff = last.rstart;
+    }
+
+    table.publish( i, soff, key, true );
+}
+
+long InterleavedSearch::resolve( BoundaryTable& table, long first, long last )
+{
+    const static std::string fnname{"InterleavedSearch::resolve"};
+
+    std::vector<Task> running;
+    std::vector<Probe*> polling;
+    long resolved = 0;
+    long next = first;
+
+    probes_ = misses_ = blocking_ = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    while ( true ) {
+        // keep the searches in flight topped up; a search runs until its first miss.
+        while ( running.size() < inflight_ && next < last ) {
+            if ( table.claim( next ) ) {
+                running.push_back( search( table, next ) );
+                running.back().handle.resume();
+                ++resolved;
+            }
+            ++next;
+        }
+
+        for ( size_t t = 0; t < running.size(); ) {
+            if ( running[t].handle.done() ) {
+                running[t].handle.destroy();
+                running[t] = running.back();
+                running.pop_back();
+            } else {
+                ++t;
+            }
+        }
+
+        if ( running.empty() ) {
+            if ( next < last ) continue;
+            break;
+        }
+
+        // poll the misses; a search whose pages arrived runs until its next miss.
+        bool progress = false;
+        polling.swap( waiting_ );
+        for ( Probe* p : polling ) {
+            if ( attempt( *p, p->misses >= RETRIES ) ) {
+                progress = true;
+                p->waiter.resume();
+            } else {
+                waiting_.push_back( p );
+            }
+        }
+        polling.clear();
+
+        if ( !progress ) std::this_thread::sleep_for( std::chrono::microseconds( 20 ) );
+    }
+
+    double ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    logger_->info( "{} resolved {} boundaries in {:.1f} ms with {} searches in flight: {} probes; {} page cache misses; {} blocking reads.", fnname, resolved, ms, inflight_, probes_, misses_, blocking_ );
+    return resolved;
+}
+
+#else
+
+bool InterleavedSearch::available( void )
+{
+    return false;
+}
+
+long InterleavedSearch::resolve( BoundaryTable&, long, long )
+{
+    return -1;
+}
+
+#endif
@@ -0,0 +1,238 @@
+#include "keyindex.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace {
+
+const char MAGIC[8] = { 'F', 'S', 'K', 'I', 'D', 'X', '0', '1' };
+
+template<typename T>
+bool put( FILE* f, const T& v )
+{
+    return fwrite( &v, sizeof v, 1, f ) == 1;
+}
+
+template<typename T>
+bool get( FILE* f, T& v )
+{
+    return fread( &v, sizeof v, 1, f ) == 1;
+}
+
+}  // end anonymous namespace.
+
+std::string KeyIndex::sidecarName( const std::string& ifname, const std::vector<uint32_t>& keylist )
+{
+    std::string fn{ ifname };
+    char sep = '.';
+
+    for ( uint32_t k : keylist ) {
+        fn += sep;
+        fn += std::to_string( k );
+        sep = '-';
+    }
+
+    return fn + ".fsidx";
+}
+
+KeyIndex::KeyIndex( FileSplitter::LogPtr logger ) :
+    logger_{ logger },
+    interval_{ 0 },
+    offsets_{},
+    keys_{}
+{
+}
+
+bool KeyIndex::identity( const std::string& ifname, long hlen, Identity& id )
+{
+    struct stat finfo;
+
+    if ( stat( ifname.c_str(), &finfo ) != 0 ) return false;
+
+    id.size = finfo.st_size;
+    id.mtime_sec = finfo.st_mtime;
+#ifdef __linux__
+    id.mtime_nsec = finfo.st_mtim.tv_nsec;
+#else
+    id.mtime_nsec = 0;
+#endif
+    id.inode = finfo.st_ino;
+    id.device = finfo.st_dev;
+    id.hlen = hlen;
+    return true;
+}
+
+bool KeyIndex::load( const std::string& fn, const std::string& ifname, const std::vector<uint32_t>& keylist, long hlen )
+{
+    const static std::string fnname{"KeyIndex::load"};
+
+    Identity now, then;
+    char magic[8];
+    uint32_t nkeys, k, len;
+    uint64_t n;
+    int64_t interval, off;
+    bool ok;
+
+    offsets_.clear();
+    keys_.clear();
+
+    FILE* f = fopen( fn.c_str(), "rb" );
+    if ( !f ) return false;
+
+    ok = identity( ifname, hlen, now ) && fread( magic, sizeof magic, 1, f ) == 1 && std::memcmp( magic, MAGIC, sizeof magic ) == 0
+        && get( f, then ) && std::memcmp( &now, &then, sizeof now ) == 0 && get( f, interval ) && get( f, nkeys ) && nkeys == keylist.size();
+
+    for ( uint32_t i = 0; ok && i < nkeys; ++i ) {
+        ok = get( f, k ) && k == keylist[i];
+    }
+
+    if ( !ok ) {
+        logger_->info( "{} {} is stale or belongs to another input or key; it will be rebuilt.", fnname, fn );
+        fclose( f );
+        return false;
+    }
+
+    ok = get( f, n );
+    std::string key;
+    for ( uint64_t i = 0; ok && i < n; ++i ) {
+        ok = get( f, off ) && get( f, len );
+        if ( ok ) {
+            key.resize( len );
+            ok = len == 0 || fread( &key[0], len, 1, f ) == 1;
+        }
+        if ( ok ) {
+            offsets_.push_back( off );
+            keys_.push_back( key );
+        }
+    }
+    fclose( f );
+
+    if ( !ok ) {
+        logger_->warn( "{} {} is truncated; it will be rebuilt.", fnname, fn );
+        offsets_.clear();
+        keys_.clear();
+        return false;
+    }
+
+    interval_ = interval;
+    logger_->info( "{} loaded {} entries (one every {} bytes) from {}.", fnname, offsets_.size(), interval_, fn );
+    return true;
+}
+
+bool KeyIndex::build( BlockHandler& handler, long begin, long end, long interval )
+{
+    const static std::string fnname{"KeyIndex::build"};
+    std::string key;
+
+    offsets_.clear();
+    keys_.clear();
+    interval_ = ( interval > 0 ) ? interval : DEFAULT_INTERVAL;
+
+    for ( long off = begin; off < end; off += interval_ ) {
+        long rsoff = handler.setRecordMultiKey( off, key );
+        if ( rsoff < 0 ) {
+            offsets_.clear();
+            keys_.clear();
+            return false;
+        }
+
+        // a record longer than the interval.
+        if ( !offsets_.empty() && rsoff <= offsets_.back() ) continue;
+
+        offsets_.push_back( rsoff );
+        keys_.push_back( key );
+    }
+
+    logger_->info( "{} built {} entries (one every {} bytes).", fnname, offsets_.size(), interval_ );
+    return true;
+}
+
+bool KeyIndex::save( const std::string& fn, const std::string& ifname, const std::vector<uint32_t>& keylist, long hlen ) const
+{
+    const static std::string fnname{"KeyIndex::save"};
+
+    Identity id;
+    if ( !identity( ifname, hlen, id ) ) return false;
+
+    // write next to the final name and rename, so a reader never sees half an index.
+    std::string tmp = fn + ".tmp";
+    FILE* f = fopen( tmp.c_str(), "wb" );
+    if ( !f ) {
+        logger_->warn( "{} unable to create {}; the index is not kept.", fnname, tmp );
+        return false;
+    }
+
+    int64_t interval = interval_;
+    uint32_t nkeys = keylist.size();
+    uint64_t n = offsets_.size();
+    bool ok = fwrite( MAGIC, sizeof MAGIC, 1, f ) == 1 && put( f, id ) && put( f, interval ) && put( f, nkeys );
+
+    for ( uint32_t k : keylist ) {
+        ok = ok && put( f, k );
+    }
+
+    ok = ok && put( f, n );
+    for ( std::size_t i = 0; ok && i < offsets_.size(); ++i ) {
+        int64_t off = offsets_[i];
+        uint32_t len = keys_[i].size();
+        ok = put( f, off ) && put( f, len ) && ( len == 0 || fwrite( keys_[i].data(), len, 1, f ) == 1 );
+    }
+
+    ok = ( fclose( f ) == 0 ) && ok;
+    if ( !ok || std::rename( tmp.c_str(), fn.c_str() ) != 0 ) {
+        logger_->warn( "{} unable to write {}; the index is not kept.", fnname, fn );
+        std::remove( tmp.c_str() );
+        return false;
+    }
+
+    logger_->info( "{} wrote {} entries to {}.", fnname, offsets_.size(), fn );
+    return true;
+}
+
+void KeyIndex::narrowFirst( const std::string& key, long& begin, long& end ) const
+{
+    // the entries strictly inside (begin, end); those in the run of key are a suffix of them.
+    std::size_t lo = std::upper_bound( offsets_.begin(), offsets_.end(), begin ) - offsets_.begin();
+    std::size_t hi = std::lower_bound( offsets_.begin() + lo, offsets_.end(), end ) - offsets_.begin();
+    std::size_t first = lo, last = hi;
+
+    while ( first < last ) {
+        std::size_t mid = first + (last - first) / 2;
+        if ( keys_[mid] == key ) {
+            last = mid;
+        } else {
+            first = mid + 1;
+        }
+    }
+
+    if ( first > lo ) begin = offsets_[first - 1];
+    if ( first < hi ) end = offsets_[first];
+}
+
+void KeyIndex::narrowNext( const std::string& key, long soff, long& from, long& end ) const
+{
+    // the entries strictly inside (soff, end); those in the run of key are a prefix of them.
+    std::size_t lo = std::upper_bound( offsets_.begin(), offsets_.end(), soff ) - offsets_.begin();
+    std::size_t hi = std::lower_bound( offsets_.begin() + lo, offsets_.end(), end ) - offsets_.begin();
+    std::size_t first = lo, last = hi;
+
+    while ( first < last ) {
+        std::size_t mid = first + (last - first) / 2;
+        if ( keys_[mid] == key ) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+
+    from = ( first > lo ) ? offsets_[first - 1] : soff;
+    if ( first < hi ) end = offsets_[first];
+}
+
+std::size_t KeyIndex::size( void ) const
+{
+    return offsets_.size();
+}
@@ -0,0 +1,241 @@
+#include "keymodel.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+
+bool digits( const char*& p, const char* e, int max, int64_t& v, int& count )
+{
+    count = 0;
+    while ( p < e && *p >= '0' && *p <= '9' && count < max ) {
+        v = v * 10 + (*p++ - '0');
+        ++count;
+    }
+    return count > 0;
+}
+
+bool fixed( const char*& p, const char* e, int n, int64_t& v )
+{
+    int count;
+    v = 0;
+    return digits( p, e, n, v, count ) && count == n;
+}
+
+// days since 1970-01-01 of a proleptic gregorian date.
+int64_t daysFromCivil( int64_t y, int64_t m, int64_t d )
+{
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+bool timestamp( const char* p, const char* e, int64_t& v )
+{
+    int64_t year, month, day, hour = 0, minute = 0, second = 0, micros = 0;
+
+    if ( !fixed( p, e, 4, year ) || p == e || *p++ != '-' || !fixed( p, e, 2, month ) || p == e || *p++ != '-' || !fixed( p, e, 2, day ) ) {
+        return false;
+    }
+    if ( month < 1 || month > 12 || day < 1 || day > 31 ) return false;
+
+    if ( p < e && (*p == 'T' || *p == ' ') ) {
+        ++p;
+        if ( !fixed( p, e, 2, hour ) || p == e || *p++ != ':' || !fixed( p, e, 2, minute ) ) return false;
+        if ( p < e && *p == ':' ) {
+            ++p;
+            if ( !fixed( p, e, 2, second ) ) return false;
+            if ( p < e && (*p == '.' || *p == ',') ) {
+                int count;
+                ++p;
+                if ( !digits( p, e, 6, micros, count ) ) return false;
+                for ( ; count < 6; ++count ) micros *= 10;
+                while ( p < e && *p >= '0' && *p <= '9' ) ++p;
+            }
+        }
+    }
+
+    int64_t offset = 0;
+    if ( p < e && *p == 'Z' ) {
+        ++p;
+    } else if ( p < e && (*p == '+' || *p == '-') ) {
+        int64_t sign = ( *p++ == '-' ) ? -1 : 1;
+        int64_t oh, om = 0;
+        if ( !fixed( p, e, 2, oh ) ) return false;
+        if ( p < e && *p == ':' ) ++p;
+        if ( p < e && !fixed( p, e, 2, om ) ) return false;
+        offset = sign * (oh * 3600 + om * 60);
+    }
+
+    if ( p != e ) return false;
+
+    v = ((daysFromCivil( year, month, day ) * 86400 + hour * 3600 + minute * 60 + second - offset) * 1000000) + micros;
+    return true;
+}
+
+}  // end anonymous namespace.
+
+bool KeyModel::parse( const std::string& name, Type& type )
+{
+    if ( "string" == name ) {
+        type = Type::STRING;
+    } else if ( "int" == name ) {
+        type = Type::INT;
+    } else if ( "decimal" == name ) {
+        type = Type::DECIMAL;
+    } else if ( "time" == name ) {
+        type = Type::TIME;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool KeyModel::value( Type type, const char* p, std::size_t n, int64_t& v )
+{
+    const char* e = p + n;
+    int count;
+
+    while ( p < e && (*p == ' ' || *p == '"') ) ++p;
+    while ( e > p && (e[-1] == ' ' || e[-1] == '"' || e[-1] == '\r') ) --e;
+    if ( p == e ) return false;
+
+    if ( type == Type::TIME ) return timestamp( p, e, v );
+    if ( type == Type::STRING ) return false;
+
+    int64_t sign = 1;
+    if ( *p == '-' || *p == '+' ) sign = ( *p++ == '-' ) ? -1 : 1;
+
+    // 18 digits always fit in 64 bits.
+    v = 0;
+    if ( !digits( p, e, 18, v, count ) ) return false;
+
+    if ( type == Type::DECIMAL ) {
+        int64_t frac = 0;
+        count = 0;
+        if ( p < e && *p == '.' ) {
+            ++p;
+            digits( p, e, 6, frac, count );
+            while ( p < e && *p >= '0' && *p <= '9' ) ++p;
+        }
+        for ( ; count < 6; ++count ) frac *= 10;
+        if ( v > INT64_MAX / 1000000 - 1 ) return false;
+        v = v * 1000000 + frac;
+    }
+
+    v *= sign;
+    return p == e;
+}
+
+KeyModel::KeyModel( Type type, FileSplitter::LogPtr logger ) :
+    type_{ type },
+    logger_{ logger },
+    offsets_{},
+    values_{},
+    error_{ 0 },
+    step_{ 1 }
+{
+}
+
+bool KeyModel::build( BlockHandler& handler, long begin, long end )
+{
+    const static std::string fnname{"KeyModel::build"};
+    std::string key;
+    int64_t v;
+
+    offsets_.clear();
+    values_.clear();
+    if ( type_ == Type::STRING || end <= begin ) return false;
+
+    for ( unsigned i = 0; i < SAMPLES; ++i ) {
+        long off = handler.setRecordMultiKey( begin + (end - begin) * i / SAMPLES, key );
+        if ( off < 0 ) return false;
+        if ( !offsets_.empty() && off <= offsets_.back() ) continue;
+
+        if ( !value( type_, key.data(), key.size(), v ) ) {
+            logger_->warn( "{} the key {} at {} is not of the declared type; searching without the model.", fnname, key, off );
+            offsets_.clear();
+            return false;
+        }
+
+        if ( !values_.empty() && v < values_.back() ) {
+            logger_->warn( "{} the keys are not in increasing order of their values at {}; searching without the model.", fnname, off );
+            offsets_.clear();
+            values_.clear();
+            return false;
+        }
+
+        offsets_.push_back( off );
+        values_.push_back( v );
+    }
+
+    // the typical error: predict every sample from its two neighbors and keep the 90th percentile.
+    std::vector<long> errors;
+    for ( std::size_t j = 1; j + 1 < offsets_.size(); ++j ) {
+        if ( values_[j+1] == values_[j-1] ) continue;
+        double f = static_cast<double>( values_[j] - values_[j-1] ) / static_cast<double>( values_[j+1] - values_[j-1] );
+        long p = offsets_[j-1] + static_cast<long>( f * (offsets_[j+1] - offsets_[j-1]) );
+        errors.push_back( std::labs( p - offsets_[j] ) );
+    }
+
+    error_ = 1;
+    if ( !errors.empty() ) {
+        std::size_t k = errors.size() * 9 / 10;
+        std::nth_element( errors.begin(), errors.begin() + k, errors.end() );
+        error_ = std::max( errors[k], 1L );
+    }
+
+    // the keys take values a multiple of step_ apart (whole seconds, cents, ...); the next run starts one step above.
+    step_ = 0;
+    for ( std::size_t j = 1; j < values_.size() && step_ != 1; ++j ) {
+        int64_t a = values_[j] - values_[j-1];
+        int64_t b = step_;
+        while ( b != 0 ) {
+            int64_t t = a % b;
+            a = b;
+            b = t;
+        }
+        step_ = a;
+    }
+    if ( step_ <= 0 ) step_ = 1;
+
+    logger_->info( "{} {} samples from {} to {}; typical error {} bytes; value step {}.", fnname, offsets_.size(), values_.front(), values_.back(), error_, step_ );
+    return offsets_.size() >= 2;
+}
+
+long KeyModel::interpolate( std::size_t j, int64_t v ) const
+{
+    // v is in (values_[j-1], values_[j]].
+    double f = static_cast<double>( v - values_[j-1] ) / static_cast<double>( values_[j] - values_[j-1] );
+    return offsets_[j-1] + static_cast<long>( f * (offsets_[j] - offsets_[j-1]) );
+}
+
+bool KeyModel::predict( const std::string& key, long& offset, long& error ) const
+{
+    int64_t v;
+
+    if ( offsets_.size() < 2 || !value( type_, key.data(), key.size(), v ) ) return false;
+    return locate( v, offset, error );
+}
+
+bool KeyModel::predictEnd( const std::string& key, long& offset, long& error ) const
+{
+    int64_t v;
+
+    if ( offsets_.size() < 2 || !value( type_, key.data(), key.size(), v ) || v > INT64_MAX - step_ ) return false;
+    return locate( v + step_, offset, error );
+}
+
+bool KeyModel::locate( int64_t v, long& offset, long& error ) const
+{
+    // the first sample with a value that is not less than v; the run starts after the sample before it.
+    std::size_t j = std::lower_bound( values_.begin(), values_.end(), v ) - values_.begin();
+    if ( j == 0 || j == values_.size() ) return false;
+
+    offset = interpolate( j, v );
+    error = error_;
+    return true;
+}
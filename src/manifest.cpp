@@ -0,0 +1,187 @@
+#include "manifest.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+constexpr char Manifest::MAGIC[8];
+
+namespace {
+
+// CSV field: quoted when it has a delimiter, a quote or a line break.
+std::string csvField( const std::string& s )
+{
+    if ( s.find_first_of( ",\"\r\n" ) == std::string::npos ) return s;
+
+    std::string q{"\""};
+    for ( char c : s ) {
+        if ( c == '"' ) q += '"';
+        q += c;
+    }
+    return q + '"';
+}
+
+std::string jsonString( const std::string& s )
+{
+    std::string q{"\""};
+    char buf[8];
+
+    for ( unsigned char c : s ) {
+        if ( c == '"' || c == '\\' ) {
+            q += '\\';
+            q += c;
+        } else if ( c < 0x20 ) {
+            std::snprintf( buf, sizeof buf, "\\u%04x", c );
+            q += buf;
+        } else {
+            q += c;
+        }
+    }
+    return q + '"';
+}
+
+}  // end anonymous namespace.
+
+Manifest::Manifest( unsigned workers, FileSplitter::LogPtr logger ) :
+    logger_{ logger },
+    lists_( workers > 0 ? workers : 1 ),
+    runs_{},
+    counted_{ false }
+{
+}
+
+void Manifest::add( unsigned worker, const std::string& key, long offset, long length )
+{
+    lists_[ worker % lists_.size() ].push_back( Run{ key, offset, length, -1 } );
+}
+
+bool Manifest::finish( const std::string& ifname, bool count )
+{
+    const static std::string fnname{"Manifest::finish"};
+
+    runs_.clear();
+    for ( auto& list : lists_ ) {
+        std::move( list.begin(), list.end(), std::back_inserter( runs_ ) );
+        list.clear();
+    }
+
+    counted_ = false;
+    if ( count ) {
+        int fd = ::open( ifname.c_str(), O_RDONLY );
+        if ( fd < 0 ) {
+            logger_->error( "{} unable to open {} to count the records.", fnname, ifname );
+            return false;
+        }
+
+        std::vector<char> buf( 1 << 20 );
+        for ( Run& r : runs_ ) {
+            long records = 0;
+            char last = FileSplitter::rdelim;
+            for ( long done = 0; done < r.length; ) {
+                ssize_t n = pread( fd, buf.data(), std::min<long>( buf.size(), r.length - done ), r.offset + done );
+                if ( n < 0 && errno == EINTR ) continue;
+                if ( n <= 0 ) {
+                    logger_->error( "{} unable to read {} at {}.", fnname, ifname, r.offset + done );
+                    ::close( fd );
+                    return false;
+                }
+                records += std::count( buf.data(), buf.data() + n, FileSplitter::rdelim );
+                last = buf[n-1];
+                done += n;
+            }
+            // the last record of the file may not be terminated.
+            r.records = records + ( ( r.length > 0 && last != FileSplitter::rdelim ) ? 1 : 0 );
+        }
+        ::close( fd );
+        counted_ = true;
+    }
+
+    std::sort( runs_.begin(), runs_.end(), []( const Run& a, const Run& b ) { return a.key < b.key; } );
+    logger_->info( "{} {} key runs{}.", fnname, runs_.size(), counted_ ? " with record counts" : "" );
+    return true;
+}
+
+bool Manifest::write( const std::string& fn, const std::string& ifname, const std::string& header ) const
+{
+    const static std::string fnname{"Manifest::write"};
+
+    FileHeader fh;
+    std::memset( &fh, 0, sizeof fh );
+    std::memcpy( fh.magic, MAGIC, sizeof MAGIC );
+    fh.version = 1;
+    fh.counted = counted_ ? 1 : 0;
+    if ( !KeyIndex::identity( ifname, header.length(), fh.input ) ) {
+        logger_->error( "{} unable to stat {}.", fnname, ifname );
+        return false;
+    }
+    fh.count = runs_.size();
+    fh.pool = sizeof fh + runs_.size() * sizeof(Entry);
+
+    // the pool starts with the header line; the keys follow in entry order.
+    std::vector<Entry> entries( runs_.size() );
+    uint64_t pos = header.length();
+    for ( std::size_t i = 0; i < runs_.size(); ++i ) {
+        entries[i] = Entry{ runs_[i].offset, runs_[i].length, runs_[i].records, pos, static_cast<uint32_t>( runs_[i].key.size() ), 0 };
+        pos += runs_[i].key.size();
+    }
+
+    std::string tmp = fn + ".tmp";
+    FILE* f = fopen( tmp.c_str(), "wb" );
+    if ( !f ) {
+        logger_->error( "{} unable to create {}.", fnname, tmp );
+        return false;
+    }
+
+    bool ok = fwrite( &fh, sizeof fh, 1, f ) == 1
+        && ( entries.empty() || fwrite( entries.data(), sizeof(Entry), entries.size(), f ) == entries.size() )
+        && ( header.empty() || fwrite( header.data(), header.length(), 1, f ) == 1 );
+    for ( const Run& r : runs_ ) {
+        ok = ok && ( r.key.empty() || fwrite( r.key.data(), r.key.size(), 1, f ) == 1 );
+    }
+
+    ok = ( fclose( f ) == 0 ) && ok;
+    if ( !ok || std::rename( tmp.c_str(), fn.c_str() ) != 0 ) {
+        logger_->error( "{} unable to write {}.", fnname, fn );
+        std::remove( tmp.c_str() );
+        return false;
+    }
+
+    logger_->info( "{} wrote {} entries to {}.", fnname, runs_.size(), fn );
+    return true;
+}
+
+bool Manifest::writeCSV( const std::string& fn ) const
+{
+    FILE* f = fopen( fn.c_str(), "w" );
+    if ( !f ) return false;
+
+    fprintf( f, "key,offset,length,records\n" );
+    for ( const Run& r : runs_ ) {
+        fprintf( f, "%s,%ld,%ld,%ld\n", csvField( r.key ).c_str(), r.offset, r.length, r.records );
+    }
+
+    return fclose( f ) == 0;
+}
+
+bool Manifest::writeJSON( const std::string& fn ) const
+{
+    FILE* f = fopen( fn.c_str(), "w" );
+    if ( !f ) return false;
+
+    fprintf( f, "[" );
+    for ( std::size_t i = 0; i < runs_.size(); ++i ) {
+        const Run& r = runs_[i];
+        fprintf( f, "%s\n  {\"key\": %s, \"offset\": %ld, \"length\": %ld, \"records\": %ld}", i ? "," : "", jsonString( r.key ).c_str(), r.offset, r.length, r.records );
+    }
+    fprintf( f, "\n]\n" );
+
+    return fclose( f ) == 0;
+}
+
+std::size_t Manifest::size( void ) const
+{
+    return runs_.size();
+}
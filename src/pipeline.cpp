@@ -0,0 +1,75 @@
+#include "pipeline.hpp"
+
+#include <chrono>
+#include <thread>
+
+Pipeline::Pipeline( unsigned writers ) :
+    queue_{ DEPTH },
+    writers_{ writers },
+    finished_{ false },
+    stalls_{ 0 },
+    starves_{ 0 }
+{
+}
+
+unsigned Pipeline::writers( void ) const
+{
+    return writers_;
+}
+
+void Pipeline::backoff( int& spins )
+{
+    // yield for a while first: the other stage is usually only a copy or a search away.
+    if ( ++spins < SPINS ) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for( std::chrono::microseconds( 100 ) );
+    }
+}
+
+void Pipeline::push( BlockTask task )
+{
+    int spins = 0;
+
+    if ( queue_.enqueue( std::move( task ) ) ) return;
+
+    ++stalls_;
+    // enqueue only moves from task when it succeeds.
+    while ( !queue_.enqueue( std::move( task ) ) ) {
+        backoff( spins );
+    }
+}
+
+bool Pipeline::next( BlockTask& task )
+{
+    int spins = 0;
+    bool waited = false;
+
+    while ( !queue_.dequeue( task ) ) {
+        // every push happened before finish, so an empty queue after finish stays empty.
+        if ( finished_ ) return queue_.dequeue( task );
+
+        if ( !waited ) {
+            ++starves_;
+            waited = true;
+        }
+        backoff( spins );
+    }
+
+    return true;
+}
+
+void Pipeline::finish( void )
+{
+    finished_ = true;
+}
+
+long Pipeline::stalls( void ) const
+{
+    return stalls_;
+}
+
+long Pipeline::starves( void ) const
+{
+    return starves_;
+}
@@ -0,0 +1,134 @@
+#include "planner.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+Planner::Planner( BlockHandler& handler, long begin, long end, FileSplitter::LogPtr logger ) :
+    handler_{ handler },
+    begin_{ begin },
+    end_{ end },
+    logger_{ logger },
+    samples_{}
+{
+}
+
+const char* Planner::name( SearchStrategy search )
+{
+    switch ( search ) {
+        case SearchStrategy::BISECT : return "bisect";
+        case SearchStrategy::GALLOP : return "gallop";
+        case SearchStrategy::STREAM : return "stream";
+        default :                     return "auto";
+    }
+}
+
+bool Planner::sample( unsigned n )
+{
+    const static std::string fnname{"Planner::sample"};
+
+    // a fixed seed: the same input is always planned the same way.
+    std::mt19937_64 rng{ 0x5eed };
+    std::uniform_int_distribution<long> offsets{ begin_, end_ - 1 };
+    std::string next_key;
+
+    samples_.clear();
+    if ( end_ <= begin_ ) return true;
+
+    for ( unsigned i = 0; i < n; ++i ) {
+        Sample s{ 0, 0, std::string{}, false };
+
+        if ( (s.offset = handler_.setRecordMultiKey( offsets( rng ), s.key )) < 0 || (s.length = handler_.recordLength( s.offset )) <= 0 ) {
+            logger_->error( "{} unable to read a sample record.", fnname );
+            return false;
+        }
+
+        if ( s.offset + s.length < end_ ) {
+            if ( handler_.setRecordMultiKey( s.offset + s.length, next_key ) < 0 ) {
+                logger_->error( "{} unable to read a sample record.", fnname );
+                return false;
+            }
+            s.same_next = ( next_key == s.key );
+        }
+
+        samples_.push_back( std::move( s ) );
+    }
+
+    std::sort( samples_.begin(), samples_.end(), []( const Sample& a, const Sample& b ) { return a.offset < b.offset; } );
+
+    Estimate e = estimate( begin_, end_ );
+    long distinct = 1;
+    for ( size_t i = 1; i < samples_.size(); ++i ) {
+        if ( samples_[i].key != samples_[i-1].key ) ++distinct;
+    }
+
+    logger_->info( "{} {} samples: {} distinct keys; record length ~{:.0f} bytes; run length ~{:.0f} bytes; ~{:.0f} keys in the file.", fnname, samples_.size(), distinct, e.record_bytes, e.run_bytes, e.runs );
+    return true;
+}
+
+Planner::Estimate Planner::estimate( long begin, long end ) const
+{
+    auto first = std::lower_bound( samples_.begin(), samples_.end(), begin, []( const Sample& s, long off ) { return s.offset < off; } );
+    auto last = std::lower_bound( first, samples_.end(), end, []( const Sample& s, long off ) { return s.offset < off; } );
+
+    // too few samples to say anything about this region alone.
+    if ( last - first < 2 ) {
+        first = samples_.begin();
+        last = samples_.end();
+    }
+
+    return estimate( first, last, begin, end );
+}
+
+Planner::Estimate Planner::estimate( std::vector<Sample>::const_iterator first, std::vector<Sample>::const_iterator last, long begin, long end ) const
+{
+    Estimate e{ last - first, 1.0, 1.0, 1.0, 0.0, 0.0, 0.0, SearchStrategy::GALLOP };
+    double bytes = static_cast<double>( end - begin );
+
+    if ( e.samples == 0 || bytes <= 0 ) return e;
+
+    double length = 0.0;
+    double same = 0.0;
+    double changes = 0.0;
+    for ( auto it = first; it != last; ++it ) {
+        length += it->length;
+        if ( it->same_next ) same += 1.0;
+        if ( it != first && it->key != (it-1)->key ) changes += 1.0;
+    }
+
+    double n = static_cast<double>( e.samples );
+    e.record_bytes = length / n;
+
+    // runs shorter than the sample spacing: the chance the next record has the same key tells their length (a geometric
+    // distribution).  longer runs: count the key changes between neighboring samples.
+    double spacing = bytes / n;
+    double short_runs = e.record_bytes / std::max( 1.0 - same / n, 1.0 / (n + 1.0) );
+    double long_runs = ( changes > 0.0 ) ? spacing / (changes / std::max( n - 1.0, 1.0 )) : bytes;
+    e.run_bytes = std::max( ( short_runs < spacing ) ? short_runs : long_runs, e.record_bytes );
+
+    e.runs = std::max( bytes / e.run_bytes, 1.0 );
+    double records = bytes / e.record_bytes;
+
+    e.bisect = e.runs * std::log2( (end - begin_) / e.record_bytes + 1.0 );
+    e.gallop = e.runs * 2.0 * std::log2( e.run_bytes / e.record_bytes + 2.0 );
+    e.stream = bytes / STREAM_BYTES + records / KEYS_PER_PROBE;
+
+    if ( e.bisect <= e.gallop && e.bisect <= e.stream ) {
+        e.choice = SearchStrategy::BISECT;
+    } else if ( e.gallop <= e.stream ) {
+        e.choice = SearchStrategy::GALLOP;
+    } else {
+        e.choice = SearchStrategy::STREAM;
+    }
+
+    return e;
+}
+
+SearchStrategy Planner::choose( long begin, long end ) const
+{
+    const static std::string fnname{"Planner::choose"};
+
+    Estimate e = estimate( begin, end );
+    logger_->debug( "{} [{},{}): {} samples; ~{:.0f} runs of ~{:.0f} bytes; probes: bisect {:.0f} gallop {:.0f} stream {:.0f}; using {}.", fnname, begin, end, e.samples, e.runs, e.run_bytes, e.bisect, e.gallop, e.stream, name( e.choice ) );
+    return e.choice;
+}
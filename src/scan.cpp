@@ -0,0 +1,260 @@
+#include "scan.hpp"
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace scan {
+
+namespace {
+
+const char* findLastScalar( const char* p, std::size_t n, char c )
+{
+    while ( n > 0 ) {
+        --n;
+        if ( p[n] == c ) return p + n;
+    }
+    return nullptr;
+}
+
+const char* findNthScalar( const char* p, std::size_t n, char c, std::size_t k )
+{
+    for ( std::size_t i = 0; i < n; ++i ) {
+        if ( p[i] == c && --k == 0 ) return p + i;
+    }
+    return nullptr;
+}
+
+#ifdef SCAN_X86
+
+/**
+ * @brief Return the position of the k-th (1-based) set bit of mask; mask must have at least k bits set.
+ */
+inline std::size_t nthBit( uint64_t mask, std::size_t k )
+{
+    while ( --k ) mask &= mask - 1;
+    return __builtin_ctzll( mask );
+}
+
+__attribute__((target("sse2")))
+const char* findNthSse2( const char* p, std::size_t n, char c, std::size_t k )
+{
+    const __m128i needle = _mm_set1_epi8( c );
+
+    while ( n >= 16 ) {
+        __m128i block = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p ) );
+        uint64_t mask = static_cast<unsigned>( _mm_movemask_epi8( _mm_cmpeq_epi8( block, needle ) ) );
+        std::size_t count = __builtin_popcountll( mask );
+
+        if ( count >= k ) return p + nthBit( mask, k );
+
+        k -= count;
+        p += 16;
+        n -= 16;
+    }
+
+    return findNthScalar( p, n, c, k );
+}
+
+__attribute__((target("avx2,popcnt,bmi")))
+const char* findNthAvx2( const char* p, std::size_t n, char c, std::size_t k )
+{
+    const __m256i needle = _mm256_set1_epi8( c );
+
+    // one 64-bit mask per 64 bytes: skip whole blocks by their popcount.
+    while ( n >= 64 ) {
+        __m256i lo = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( p ) );
+        __m256i hi = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( p + 32 ) );
+        uint64_t mask = static_cast<uint32_t>( _mm256_movemask_epi8( _mm256_cmpeq_epi8( lo, needle ) ) ) |
+                        (static_cast<uint64_t>( static_cast<uint32_t>( _mm256_movemask_epi8( _mm256_cmpeq_epi8( hi, needle ) ) ) ) << 32);
+        std::size_t count = __builtin_popcountll( mask );
+
+        if ( count >= k ) return p + nthBit( mask, k );
+
+        k -= count;
+        p += 64;
+        n -= 64;
+    }
+
+    return findNthSse2( p, n, c, k );
+}
+
+__attribute__((target("sse2")))
+const char* findLastSse2( const char* p, std::size_t n, char c )
+{
+    const __m128i needle = _mm_set1_epi8( c );
+
+    // compare 16 bytes at a time from the back; the highest set bit of the mask is the last match.
+    while ( n >= 16 ) {
+        n -= 16;
+        __m128i block = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p + n ) );
+        unsigned mask = static_cast<unsigned>( _mm_movemask_epi8( _mm_cmpeq_epi8( block, needle ) ) );
+        if ( mask ) return p + n + 31 - __builtin_clz( mask );
+    }
+
+    return findLastScalar( p, n, c );
+}
+
+__attribute__((target("avx2")))
+const char* findLastAvx2( const char* p, std::size_t n, char c )
+{
+    const __m256i needle = _mm256_set1_epi8( c );
+
+    // compare 32 bytes at a time from the back; the highest set bit of the mask is the last match.
+    while ( n >= 32 ) {
+        n -= 32;
+        __m256i block = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( p + n ) );
+        unsigned mask = static_cast<unsigned>( _mm256_movemask_epi8( _mm256_cmpeq_epi8( block, needle ) ) );
+        if ( mask ) return p + n + 31 - __builtin_clz( mask );
+    }
+
+    return findLastSse2( p, n, c );
+}
+
+#endif
+
+/**
+ * The implementations selected for this CPU.
+ */
+struct Dispatch {
+    const char* name;
+    const char* (*findLast)( const char*, std::size_t, char );
+    const char* (*findNth)( const char*, std::size_t, char, std::size_t );
+
+    Dispatch( void ) :
+        name{ "scalar" },
+        findLast{ findLastScalar },
+        findNth{ findNthScalar }
+    {
+#ifdef SCAN_X86
+        __builtin_cpu_init();
+        if ( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "popcnt" ) && __builtin_cpu_supports( "bmi" ) ) {
+            name = "avx2";
+            findLast = findLastAvx2;
+            findNth = findNthAvx2;
+        } else if ( __builtin_cpu_supports( "sse2" ) ) {
+            name = "sse2";
+            findLast = findLastSse2;
+            findNth = findNthSse2;
+        }
+#endif
+    }
+};
+
+const Dispatch& dispatch( void )
+{
+    static const Dispatch d{};
+    return d;
+}
+
+}  // end anonymous namespace.
+
+const char* findLast( const char* p, std::size_t n, char c )
+{
+    return dispatch().findLast( p, n, c );
+}
+
+const char* findNth( const char* p, std::size_t n, char c, std::size_t k )
+{
+    return dispatch().findNth( p, n, c, k );
+}
+
+void fields( const char* rec, std::size_t len, char fdelim, const std::vector<uint32_t>& indices, std::vector<Span>& spans )
+{
+    const char* pos = rec;
+    const char* end = rec + len;
+    const char* d;
+    uint32_t f{ 1 };            // the field pos is in.
+
+    spans.clear();
+
+    auto kit = indices.begin();
+    if ( kit == indices.end() ) return;
+
+    spans.push_back( Span{ pos, 0 } );
+    while ( true ) {
+        // jump straight to the start of the wanted field.
+        if ( *kit > f ) {
+            if ( (d = findNth( pos, end - pos, fdelim, *kit - f )) == nullptr ) break;
+            pos = d + 1;
+            f = *kit;
+        }
+
+        d = static_cast<const char*>( std::memchr( pos, fdelim, end - pos ) );
+        if ( f == *kit ) {
+            spans.back() = Span{ pos, static_cast<std::size_t>( (d ? d : end) - pos ) };
+        }
+
+        if ( !d ) break;
+
+        // passing a field delimiter always moves to the next index (f >= *kit here).
+        pos = d + 1;
+        ++f;
+        if ( ++kit == indices.end() ) break;
+        spans.push_back( Span{ pos, 0 } );
+    }
+}
+
+void join( const std::vector<Span>& spans, char sep, std::string& key )
+{
+    key.clear();
+    for ( std::size_t i = 0; i < spans.size(); ++i ) {
+        if ( i > 0 ) key.push_back( sep );
+        key.append( spans[i].data, spans[i].size );
+    }
+}
+
+bool equals( const std::vector<Span>& spans, char sep, const std::string& key )
+{
+    std::size_t pos = 0;
+
+    for ( std::size_t i = 0; i < spans.size(); ++i ) {
+        if ( i > 0 ) {
+            if ( pos >= key.size() || key[pos] != sep ) return false;
+            ++pos;
+        }
+        if ( key.size() - pos < spans[i].size || std::memcmp( key.data() + pos, spans[i].data, spans[i].size ) != 0 ) return false;
+        pos += spans[i].size;
+    }
+
+    return pos == key.size();
+}
+
+uint64_t hash( const char* p, std::size_t n )
+{
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ (n * m);
+    uint64_t k;
+
+    for ( ; n >= 8; p += 8, n -= 8 ) {
+        std::memcpy( &k, p, 8 );
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    if ( n > 0 ) {
+        k = 0;
+        std::memcpy( &k, p, n );
+        h ^= k;
+        h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+const char* implementation( void )
+{
+    return dispatch().name;
+}
+
+}  // end namespace.
@@ -0,0 +1,338 @@
+#include "scatter.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+#include "scan.hpp"
+#include "transfer.hpp"
+
+DescriptorPool::DescriptorPool( const std::string& odname, const std::string& header, long capacity, FileSplitter::LogPtr logger ) :
+    odname_{ odname },
+    header_{ header },
+    capacity_{ capacity > 0 ? capacity : 1 },
+    logger_{ logger },
+    mutex_{},
+    cv_{},
+    outputs_{},
+    lru_{},
+    open_{ 0 },
+    opens_{ 0 },
+    evictions_{ 0 },
+    failed_{ false }
+{
+}
+
+DescriptorPool::~DescriptorPool( void )
+{
+    close();
+}
+
+long DescriptorPool::limit( void )
+{
+    struct rlimit rl;
+
+    if ( getrlimit( RLIMIT_NOFILE, &rl ) != 0 ) return 1;
+
+    // the hard limit is the real one; raising the soft limit needs no privileges.
+    if ( rl.rlim_cur < rl.rlim_max ) {
+        rlim_t cur = rl.rlim_cur;
+        rl.rlim_cur = rl.rlim_max;
+        if ( setrlimit( RLIMIT_NOFILE, &rl ) != 0 ) rl.rlim_cur = cur;
+    }
+
+    if ( rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur > (1L << 20) ) return 1L << 20;
+    return std::max( static_cast<long>( rl.rlim_cur ) - RESERVE, 1L );
+}
+
+bool DescriptorPool::evict( void )
+{
+    for ( auto it = lru_.rbegin(); it != lru_.rend(); ++it ) {
+        Output& out = outputs_[ *it ];
+        if ( out.busy ) continue;
+
+        if ( ::close( out.fd ) != 0 ) failed_ = true;
+        out.fd = -1;
+        lru_.erase( std::next( it ).base() );
+        --open_;
+        ++evictions_;
+        return true;
+    }
+
+    return false;
+}
+
+int DescriptorPool::acquire( const std::string& key )
+{
+    const static std::string fnname{"DescriptorPool::acquire"};
+
+    std::unique_lock<std::mutex> lock{ mutex_ };
+
+    // references into an unordered_map stay valid when it grows.
+    bool fresh = ( outputs_.find( key ) == outputs_.end() );
+    Output& out = outputs_[ key ];
+    if ( fresh ) {
+        out.fd = -1;
+        out.busy = false;
+        out.lru = lru_.end();
+    }
+
+    cv_.wait( lock, [&out] { return !out.busy; } );
+    out.busy = true;
+
+    if ( out.fd >= 0 ) {
+        lru_.splice( lru_.begin(), lru_, out.lru );
+        return out.fd;
+    }
+
+    // make room; when every open output is being written, wait for one to be released.
+    while ( open_ >= capacity_ && !evict() ) {
+        cv_.wait( lock );
+    }
+
+    std::string ofn = odname_ + key + ".csv";
+    out.fd = ::open( ofn.c_str(), O_WRONLY | O_CREAT | O_APPEND | ( fresh ? O_TRUNC : 0 ), 0666 );
+    if ( out.fd < 0 || ( fresh && !Transfer::writeAll( out.fd, header_.data(), header_.length() ) ) ) {
+        logger_->error( "{} Failed to open destination file: {}: {}", fnname, ofn, std::strerror( errno ) );
+        if ( out.fd >= 0 ) ::close( out.fd );
+        out.fd = -1;
+        return -1;
+    }
+
+    lru_.push_front( key );
+    out.lru = lru_.begin();
+    ++open_;
+    ++opens_;
+    return out.fd;
+}
+
+void DescriptorPool::release( const std::string& key )
+{
+    {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        outputs_[ key ].busy = false;
+    }
+    cv_.notify_all();
+}
+
+bool DescriptorPool::close( void )
+{
+    std::lock_guard<std::mutex> lock{ mutex_ };
+
+    for ( const std::string& key : lru_ ) {
+        Output& out = outputs_[ key ];
+        if ( ::close( out.fd ) != 0 ) failed_ = true;
+        out.fd = -1;
+    }
+    lru_.clear();
+    open_ = 0;
+
+    return !failed_;
+}
+
+long DescriptorPool::opens( void ) const
+{
+    return opens_;
+}
+
+long DescriptorPool::evictions( void ) const
+{
+    return evictions_;
+}
+
+Scatter::Scatter( const std::string& ifname, long ifsize, const std::string& header, DescriptorPool& pool, const std::vector<uint32_t>& keylist, unsigned partitions, FileSplitter::LogPtr logger ) :
+    ifname_{ ifname },
+    ifsize_{ ifsize },
+    hlen_{ static_cast<long>( header.length() ) },
+    pool_{ pool },
+    keylist_{ keylist },
+    partitions_{ partitions },
+    names_{},
+    logger_{ logger }
+{
+    for ( unsigned i = 0; i < partitions_; ++i ) {
+        names_.push_back( partName( i ) );
+    }
+}
+
+std::string Scatter::partName( unsigned i )
+{
+    char name[32];
+    std::snprintf( name, sizeof name, "part-%05u", i );
+    return name;
+}
+
+bool Scatter::run( unsigned threads )
+{
+    const static std::string fnname{"Scatter::run"};
+
+    if ( threads < 1 ) threads = 1;
+
+    long size = ( ifsize_ - hlen_ + threads - 1 ) / threads;
+    if ( size < 1 ) size = 1;
+
+    std::vector<std::thread> thread_list;
+    std::vector<long> records( threads, 0 );
+    std::atomic<bool> ok{ true };
+
+    for ( unsigned i = 0; i < threads; ++i ) {
+        long b = hlen_ + i * size;
+        long e = std::min( b + size, ifsize_ );
+        if ( b >= e ) break;
+
+        thread_list.emplace_back( [this, b, e, i, &records, &ok] {
+            if ( !scatter( b, e, records[i] ) ) ok = false;
+        } );
+    }
+
+    for ( auto& t : thread_list ) {
+        t.join();
+    }
+
+    // every bucket exists, with its header, even when no key hashed to it.
+    for ( const std::string& name : names_ ) {
+        if ( pool_.acquire( name ) < 0 ) ok = false;
+        pool_.release( name );
+    }
+
+    long total = 0;
+    for ( long r : records ) total += r;
+
+    logger_->info( "{} {} records scattered by {} threads; {} output opens, {} closed to stay under the open file limit.", fnname, total, thread_list.size(), pool_.opens(), pool_.evictions() );
+    return ok;
+}
+
+bool Scatter::flush( const std::string& key, std::string& buf )
+{
+    const static std::string fnname{"Scatter::flush"};
+
+    int fd = pool_.acquire( key );
+    bool ok = ( fd >= 0 ) && Transfer::writeAll( fd, buf.data(), buf.length() );
+    pool_.release( key );
+
+    if ( !ok ) {
+        logger_->error( "{} Failed to write {} bytes for key {}.", fnname, buf.length(), key );
+    }
+
+    buf.clear();
+    return ok;
+}
+
+bool Scatter::scatter( long begin, long end, long& records )
+{
+    const static std::string fnname{"Scatter::scatter"};
+
+    int fd = ::open( ifname_.c_str(), O_RDONLY );
+    if ( fd < 0 ) {
+        logger_->error( "{} Cannot open the input: {}.", fnname, ifname_ );
+        return false;
+    }
+    posix_fadvise( fd, begin, end - begin, POSIX_FADV_SEQUENTIAL );
+
+    std::unordered_map<std::string, std::string> buffers;      // one file per key.
+    std::vector<std::string> parts( partitions_ );              // or one buffer per bucket.
+    std::vector<scan::Span> spans;
+    std::string key;
+    long buffered = 0;
+    bool ok = true;
+
+    // the records that start in [begin, end) are ours; a range that starts mid record skips to the next one.
+    bool skip = ( begin > hlen_ );
+    long off = skip ? begin - 1 : begin;                        // the input offset of buf[0].
+    std::vector<char> buf( READSIZE );
+    std::size_t n = 0;
+    std::size_t p = 0;
+    bool eof = false;
+    bool done = false;
+
+    while ( ok && !done ) {
+        while ( p < n || eof ) {
+            const char* s = buf.data() + p;
+            const char* e = static_cast<const char*>( std::memchr( s, FileSplitter::rdelim, n - p ) );
+
+            if ( skip ) {
+                if ( !e ) {
+                    p = n;
+                    if ( eof ) done = true;
+                    break;
+                }
+                p = e + 1 - buf.data();
+                skip = false;
+                continue;
+            }
+
+            if ( off + static_cast<long>( p ) >= end || ( eof && p >= n ) ) {
+                done = true;
+                break;
+            }
+
+            // a record that is not whole yet; the last record of the input may not be terminated.
+            if ( !e && !eof ) break;
+
+            std::size_t rlen = e ? e + 1 - s : n - p;
+            scan::fields( s, e ? e - s : rlen, FileSplitter::fdelim, keylist_, spans );
+            scan::join( spans, '.', key );
+
+            std::size_t bucket = ( partitions_ > 0 ) ? scan::hash( key.data(), key.length() ) % partitions_ : 0;
+            std::string& kb = ( partitions_ > 0 ) ? parts[ bucket ] : buffers[ key ];
+            kb.append( s, rlen );
+            // the batches of an output are appended in any order, so the unterminated last record of the input gets a
+            // delimiter rather than running into the next batch.
+            if ( !e ) kb.push_back( FileSplitter::rdelim );
+            buffered += rlen;
+            ++records;
+            p += rlen;
+
+            if ( static_cast<long>( kb.length() ) >= KEYFLUSH ) {
+                buffered -= kb.length();
+                ok = flush( ( partitions_ > 0 ) ? names_[ bucket ] : key, kb ) && ok;
+            }
+
+            if ( buffered >= FLUSH ) {
+                for ( auto& entry : buffers ) {
+                    if ( !entry.second.empty() ) ok = flush( entry.first, entry.second ) && ok;
+                }
+                for ( unsigned i = 0; i < partitions_; ++i ) {
+                    if ( !parts[i].empty() ) ok = flush( names_[i], parts[i] ) && ok;
+                }
+                // give the memory of the keys that were only seen once back.
+                buffers.clear();
+                buffered = 0;
+            }
+        }
+
+        if ( done || !ok ) break;
+
+        // keep the partial record and read more after it.
+        std::memmove( buf.data(), buf.data() + p, n - p );
+        off += p;
+        n -= p;
+        p = 0;
+        if ( n == buf.size() ) buf.resize( buf.size() * 2 );
+
+        ssize_t r = pread( fd, buf.data() + n, buf.size() - n, off + n );
+        if ( r < 0 && errno == EINTR ) continue;
+        if ( r < 0 ) {
+            logger_->error( "{} read failed at {}: {}", fnname, off + n, std::strerror( errno ) );
+            ok = false;
+            break;
+        }
+        if ( r == 0 ) eof = true;
+        n += r;
+    }
+
+    for ( auto& entry : buffers ) {
+        if ( !entry.second.empty() ) ok = flush( entry.first, entry.second ) && ok;
+    }
+    for ( unsigned i = 0; i < partitions_; ++i ) {
+        if ( !parts[i].empty() ) ok = flush( names_[i], parts[i] ) && ok;
+    }
+
+    ::close( fd );
+    return ok;
+}
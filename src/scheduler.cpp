@@ -0,0 +1,103 @@
+#include "scheduler.hpp"
+
+#include <chrono>
+
+Scheduler::Scheduler( unsigned workers ) :
+    queues_{},
+    pending_{ 0 },
+    idle_{ 0 },
+    steals_{ 0 },
+    mutex_{},
+    wake_{}
+{
+    if ( workers < 1 ) workers = 1;
+    for ( unsigned w = 0; w < workers; ++w ) {
+        queues_.emplace_back( new Queue{} );
+    }
+}
+
+unsigned Scheduler::workers( void ) const
+{
+    return queues_.size();
+}
+
+void Scheduler::push( unsigned worker, BlockTask task )
+{
+    Queue& q = *queues_[ worker % queues_.size() ];
+
+    ++pending_;
+    {
+        std::lock_guard<std::mutex> lock{ q.mutex };
+        q.tasks.push_back( std::move( task ) );
+    }
+
+    if ( idle_ > 0 ) {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        wake_.notify_one();
+    }
+}
+
+bool Scheduler::take( unsigned worker, BlockTask& task )
+{
+    unsigned n = queues_.size();
+
+    // our own work first, newest first.
+    {
+        Queue& q = *queues_[worker];
+        std::lock_guard<std::mutex> lock{ q.mutex };
+        if ( !q.tasks.empty() ) {
+            task = std::move( q.tasks.back() );
+            q.tasks.pop_back();
+            return true;
+        }
+    }
+
+    // steal the oldest work of the others.
+    for ( unsigned i = 1; i < n; ++i ) {
+        Queue& q = *queues_[ (worker + i) % n ];
+        std::lock_guard<std::mutex> lock{ q.mutex };
+        if ( !q.tasks.empty() ) {
+            task = std::move( q.tasks.front() );
+            q.tasks.pop_front();
+            ++steals_;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool Scheduler::next( unsigned worker, BlockTask& task )
+{
+    while ( true ) {
+        if ( take( worker, task ) ) return true;
+        if ( pending_ == 0 ) return false;
+
+        // someone is still running a task that may push more work.
+        ++idle_;
+        {
+            std::unique_lock<std::mutex> lock{ mutex_ };
+            // the timeout covers a push that happened between take and the wait.
+            wake_.wait_for( lock, std::chrono::milliseconds( 1 ) );
+        }
+        --idle_;
+    }
+}
+
+void Scheduler::done( void )
+{
+    if ( --pending_ == 0 ) {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        wake_.notify_all();
+    }
+}
+
+bool Scheduler::hungry( void ) const
+{
+    return idle_ > 0;
+}
+
+long Scheduler::steals( void ) const
+{
+    return steals_;
+}
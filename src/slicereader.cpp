@@ -0,0 +1,213 @@
+#include "slicereader.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// map all of fn read-only; an empty file is not an error but has no mapping.
+bool mapFile( const std::string& fn, const char*& base, std::size_t& len )
+{
+    struct stat finfo;
+
+    int fd = ::open( fn.c_str(), O_RDONLY );
+    if ( fd < 0 ) return false;
+
+    if ( fstat( fd, &finfo ) != 0 || !S_ISREG( finfo.st_mode ) ) {
+        ::close( fd );
+        return false;
+    }
+
+    len = finfo.st_size;
+    base = nullptr;
+    if ( len > 0 ) {
+        void* p = mmap( nullptr, len, PROT_READ, MAP_SHARED, fd, 0 );
+        if ( p == MAP_FAILED ) {
+            ::close( fd );
+            return false;
+        }
+        base = static_cast<const char*>( p );
+    }
+
+    // the mapping keeps the file.
+    ::close( fd );
+    return true;
+}
+
+}  // end anonymous namespace.
+
+constexpr std::size_t KeySliceReader::NPOS;
+
+KeySliceReader::KeySliceReader( FileSplitter::LogPtr logger ) :
+    logger_{ logger },
+    mbase_{ nullptr },
+    mlen_{ 0 },
+    ibase_{ nullptr },
+    ilen_{ 0 },
+    fh_{ nullptr },
+    entries_{ nullptr },
+    pool_{ nullptr }
+{
+}
+
+KeySliceReader::~KeySliceReader( void )
+{
+    close();
+}
+
+bool KeySliceReader::open( const std::string& mfn, const std::string& ifname )
+{
+    const static std::string fnname{"KeySliceReader::open"};
+
+    close();
+
+    if ( !mapFile( mfn, mbase_, mlen_ ) ) {
+        logger_->error( "{} unable to map the manifest {}.", fnname, mfn );
+        return false;
+    }
+
+    fh_ = reinterpret_cast<const Manifest::FileHeader*>( mbase_ );
+    if ( mlen_ < sizeof(Manifest::FileHeader) || std::memcmp( fh_->magic, Manifest::MAGIC, sizeof Manifest::MAGIC ) != 0 || fh_->version != 1 ) {
+        logger_->error( "{} {} is not a manifest.", fnname, mfn );
+        close();
+        return false;
+    }
+
+    // the entries and the pool must be inside the file.
+    uint64_t count = fh_->count;
+    if ( count > ( mlen_ - sizeof(Manifest::FileHeader) ) / sizeof(Manifest::Entry) || fh_->pool != sizeof(Manifest::FileHeader) + count * sizeof(Manifest::Entry) || fh_->pool + static_cast<uint64_t>( fh_->input.hlen ) > mlen_ ) {
+        logger_->error( "{} the manifest {} is truncated.", fnname, mfn );
+        close();
+        return false;
+    }
+
+    entries_ = reinterpret_cast<const Manifest::Entry*>( mbase_ + sizeof(Manifest::FileHeader) );
+    pool_ = mbase_ + fh_->pool;
+
+    KeyIndex::Identity now;
+    const KeyIndex::Identity& then = fh_->input;
+    if ( !KeyIndex::identity( ifname, then.hlen, now ) || now.size != then.size || now.mtime_sec != then.mtime_sec || now.mtime_nsec != then.mtime_nsec || now.inode != then.inode || now.device != then.device ) {
+        logger_->error( "{} the manifest {} was not written for {} (or it has changed since).", fnname, mfn, ifname );
+        close();
+        return false;
+    }
+
+    if ( !mapFile( ifname, ibase_, ilen_ ) || static_cast<int64_t>( ilen_ ) != then.size ) {
+        logger_->error( "{} unable to map the input {}.", fnname, ifname );
+        close();
+        return false;
+    }
+
+    // every run and key must be inside its mapping, so the accessors need no checks.
+    uint64_t plen = mlen_ - fh_->pool;
+    for ( uint64_t i = 0; i < count; ++i ) {
+        const Manifest::Entry& e = entries_[i];
+        if ( e.offset < then.hlen || e.length < 0 || e.offset + e.length > then.size || e.key + e.keylen > plen ) {
+            logger_->error( "{} the manifest {} has a bad entry ({}).", fnname, mfn, i );
+            close();
+            return false;
+        }
+    }
+
+    if ( ibase_ ) madvise( const_cast<char*>( ibase_ ), ilen_, MADV_RANDOM );
+
+    logger_->info( "{} {} keys of {} from {}.", fnname, count, ifname, mfn );
+    return true;
+}
+
+void KeySliceReader::close( void )
+{
+    if ( mbase_ ) munmap( const_cast<char*>( mbase_ ), mlen_ );
+    if ( ibase_ ) munmap( const_cast<char*>( ibase_ ), ilen_ );
+
+    mbase_ = ibase_ = nullptr;
+    mlen_ = ilen_ = 0;
+    fh_ = nullptr;
+    entries_ = nullptr;
+    pool_ = nullptr;
+}
+
+std::size_t KeySliceReader::size( void ) const
+{
+    return fh_ ? fh_->count : 0;
+}
+
+KeySliceReader::Slice KeySliceReader::header( void ) const
+{
+    // the pool starts with the header line.
+    return fh_ ? Slice{ pool_, static_cast<std::size_t>( fh_->input.hlen ) } : Slice{ nullptr, 0 };
+}
+
+int KeySliceReader::compare( std::size_t i, const std::string& key ) const
+{
+    const Manifest::Entry& e = entries_[i];
+    std::size_t n = std::min<std::size_t>( e.keylen, key.size() );
+
+    int c = ( n > 0 ) ? std::memcmp( pool_ + e.key, key.data(), n ) : 0;
+    if ( c != 0 ) return c;
+    return ( e.keylen < key.size() ) ? -1 : ( e.keylen > key.size() ) ? 1 : 0;
+}
+
+std::size_t KeySliceReader::lowerBound( const std::string& key ) const
+{
+    std::size_t lo = 0;
+    std::size_t hi = size();
+
+    while ( lo < hi ) {
+        std::size_t mid = lo + (hi - lo) / 2;
+        if ( compare( mid, key ) < 0 ) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+std::size_t KeySliceReader::find( const std::string& key ) const
+{
+    std::size_t i = lowerBound( key );
+    return ( i < size() && compare( i, key ) == 0 ) ? i : NPOS;
+}
+
+KeySliceReader::Slice KeySliceReader::key( std::size_t i ) const
+{
+    if ( i >= size() ) return Slice{ nullptr, 0 };
+    return Slice{ pool_ + entries_[i].key, entries_[i].keylen };
+}
+
+KeySliceReader::Slice KeySliceReader::records( std::size_t i ) const
+{
+    if ( i >= size() ) return Slice{ nullptr, 0 };
+    return Slice{ ibase_ + entries_[i].offset, static_cast<std::size_t>( entries_[i].length ) };
+}
+
+KeySliceReader::Slice KeySliceReader::records( const std::string& key ) const
+{
+    return records( find( key ) );
+}
+
+long KeySliceReader::count( std::size_t i ) const
+{
+    return ( i < size() ) ? entries_[i].records : -1;
+}
+
+const Manifest::Entry& KeySliceReader::entry( std::size_t i ) const
+{
+    return entries_[i];
+}
+
+void KeySliceReader::willNeed( std::size_t i ) const
+{
+    if ( i >= size() || entries_[i].length == 0 ) return;
+
+    // madvise wants a page aligned start.
+    long page = sysconf( _SC_PAGESIZE );
+    long off = entries_[i].offset & ~(page - 1);
+    madvise( const_cast<char*>( ibase_ ) + off, entries_[i].offset + entries_[i].length - off, MADV_WILLNEED );
+}
@@ -0,0 +1,321 @@
+#include "stream.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <thread>
+#include <unistd.h>
+#include "scan.hpp"
+#include "transfer.hpp"
+
+StreamSplitter::StreamSplitter( const std::string& odname, bool header, const std::vector<uint32_t>& keylist, unsigned writers, FileSplitter::LogPtr logger ) :
+    odname_{ odname },
+    has_header_{ header },
+    header_{},
+    keylist_{ keylist },
+    writers_{ writers > 0 ? writers : 1 },
+    logger_{ logger },
+    queues_{},
+    waiters_{},
+    finished_{ false },
+    failed_{ false },
+    mutex_{},
+    cv_{},
+    pool_{},
+    filled_{},
+    eof_{ false },
+    runs_{ 0 },
+    stalls_{ 0 }
+{
+    for ( unsigned w = 0; w < writers_; ++w ) {
+        queues_.emplace_back( new Queue{ DEPTH } );
+        waiters_.emplace_back( new Waiter{} );
+        waiters_.back()->sleeping = false;
+        waiters_.back()->woken = false;
+    }
+
+    for ( unsigned i = 0; i < writers_ + SPARE; ++i ) {
+        pool_.emplace_back( new Buffer{ std::vector<char>( BUFSIZE ), 0 } );
+    }
+}
+
+void StreamSplitter::backoff( int& spins )
+{
+    if ( ++spins < SPINS ) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for( std::chrono::microseconds( 100 ) );
+    }
+}
+
+bool StreamSplitter::split( int fd )
+{
+    const static std::string fnname{"StreamSplitter::split"};
+
+    std::vector<std::thread> writer_list;
+    for ( unsigned w = 0; w < writers_; ++w ) {
+        writer_list.emplace_back( &StreamSplitter::write, this, w );
+    }
+
+    std::thread reader{ &StreamSplitter::read, this, fd };
+
+    ScanState state{ std::string{}, false, true, has_header_ };
+    long bytes = 0;
+    long buffers = 0;
+
+    for ( ;; ) {
+        std::unique_ptr<Buffer> buf;
+        {
+            std::unique_lock<std::mutex> lock{ mutex_ };
+            cv_.wait( lock, [this] { return !filled_.empty() || eof_; } );
+            if ( filled_.empty() ) break;
+            buf = std::move( filled_.front() );
+            filled_.pop_front();
+        }
+        cv_.notify_all();
+
+        bytes += buf->len;
+        ++buffers;
+        scan( share( std::move( buf ) ), state );
+    }
+
+    reader.join();
+
+    finished_ = true;
+    for ( unsigned w = 0; w < writers_; ++w ) {
+        wake( w );
+    }
+    for ( auto& t : writer_list ) {
+        t.join();
+    }
+
+    logger_->info( "{} {} bytes in {} buffers; {} key runs; the writer queues were full {} times.", fnname, bytes, buffers, runs_.load(), stalls_.load() );
+    return !failed_;
+}
+
+void StreamSplitter::read( int fd )
+{
+    const static std::string fnname{"StreamSplitter::read"};
+
+    std::vector<char> carry;
+    bool done = false;
+
+    while ( !done ) {
+        std::unique_ptr<Buffer> buf;
+        {
+            std::unique_lock<std::mutex> lock{ mutex_ };
+            cv_.wait( lock, [this] { return !pool_.empty(); } );
+            buf = std::move( pool_.back() );
+            pool_.pop_back();
+        }
+
+        // the partial record at the end of the last buffer starts this one.
+        if ( buf->data.size() < carry.size() + BUFSIZE / 2 ) buf->data.resize( carry.size() + BUFSIZE );
+        std::memcpy( buf->data.data(), carry.data(), carry.size() );
+        std::size_t n = carry.size();
+        carry.clear();
+
+        // fill the buffer; a pipe hands out much less than a buffer per read.
+        const char* last = nullptr;
+        while ( !done ) {
+            while ( n < buf->data.size() ) {
+                ssize_t r = ::read( fd, buf->data.data() + n, buf->data.size() - n );
+                if ( r < 0 && errno == EINTR ) continue;
+                if ( r < 0 ) {
+                    logger_->error( "{} read failed: {}", fnname, std::strerror( errno ) );
+                    failed_ = true;
+                }
+                if ( r <= 0 ) {
+                    done = true;
+                    break;
+                }
+                n += r;
+            }
+
+            if ( done || n == 0 ) break;
+
+            // a buffer ends with a whole record; one record larger than the buffer makes it grow.
+            if ( (last = scan::findLast( buf->data.data(), n, FileSplitter::rdelim )) != nullptr ) break;
+            buf->data.resize( buf->data.size() * 2 );
+        }
+
+        // at the end of the input the last record may not be terminated.
+        buf->len = ( done || !last ) ? n : static_cast<std::size_t>( last - buf->data.data() ) + 1;
+        carry.assign( buf->data.data() + buf->len, buf->data.data() + n );
+
+        {
+            std::lock_guard<std::mutex> lock{ mutex_ };
+            if ( buf->len > 0 ) {
+                filled_.push_back( std::move( buf ) );
+            } else {
+                pool_.push_back( std::move( buf ) );
+            }
+            if ( done ) eof_ = true;
+        }
+        cv_.notify_all();
+    }
+}
+
+StreamSplitter::BufferPtr StreamSplitter::share( std::unique_ptr<Buffer> buf )
+{
+    // the buffer goes back to the pool when the scanner and the writers are done with it.
+    return BufferPtr{ buf.release(), [this]( const Buffer* b ) { release( const_cast<Buffer*>( b ) ); } };
+}
+
+void StreamSplitter::release( Buffer* buf )
+{
+    {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        pool_.emplace_back( buf );
+    }
+    cv_.notify_all();
+}
+
+void StreamSplitter::scan( BufferPtr buf, ScanState& state )
+{
+    const char* base = buf->data.data();
+    const char* p = base;
+    const char* end = base + buf->len;
+    const char* run = p;                                        // the start of the open run in this buffer.
+    std::vector<scan::Span> spans;
+
+    while ( p < end ) {
+        const char* e = static_cast<const char*>( std::memchr( p, FileSplitter::rdelim, end - p ) );
+        const char* next = e ? e + 1 : end;
+
+        if ( state.header ) {
+            // the header line is only written at the top of each output.
+            header_.assign( p, next );
+            state.header = false;
+            run = p = next;
+            continue;
+        }
+
+        scan::fields( p, ( e ? e : end ) - p, FileSplitter::fdelim, keylist_, spans );
+
+        if ( !state.started || !scan::equals( spans, '.', state.key ) ) {
+            if ( p > run ) {
+                push( std::hash<std::string>{}( state.key ) % writers_, Piece{ buf, static_cast<std::size_t>( run - base ), static_cast<std::size_t>( p - run ), state.key, state.first } );
+            }
+            scan::join( spans, '.', state.key );
+            state.started = true;
+            state.first = true;
+            run = p;
+            ++runs_;
+        }
+
+        p = next;
+    }
+
+    // the run carries on in the next buffer.
+    if ( end > run ) {
+        push( std::hash<std::string>{}( state.key ) % writers_, Piece{ buf, static_cast<std::size_t>( run - base ), static_cast<std::size_t>( end - run ), state.key, state.first } );
+        state.first = false;
+    }
+}
+
+void StreamSplitter::push( unsigned w, Piece&& piece )
+{
+    int spins = 0;
+
+    if ( !queues_[w]->enqueue( std::move( piece ) ) ) {
+        ++stalls_;
+        while ( !queues_[w]->enqueue( std::move( piece ) ) ) {
+            backoff( spins );
+        }
+    }
+
+    wake( w );
+}
+
+void StreamSplitter::wake( unsigned w )
+{
+    Waiter& waiter = *waiters_[w];
+    bool notify;
+
+    // the writer takes its last look at the queue under the mutex: either that look comes after this and sees the
+    // piece, or the writer is already sleeping here and gets woken.
+    {
+        std::lock_guard<std::mutex> lock{ waiter.mutex };
+        notify = waiter.sleeping || finished_;
+        if ( notify ) waiter.woken = true;
+    }
+    if ( notify ) waiter.cv.notify_one();
+}
+
+bool StreamSplitter::wait( unsigned w, Piece& piece )
+{
+    Queue& queue = *queues_[w];
+    Waiter& waiter = *waiters_[w];
+
+    for ( int spins = 0; spins < SPINS; ++spins ) {
+        if ( queue.dequeue( piece ) ) return true;
+        std::this_thread::yield();
+    }
+
+    for ( ;; ) {
+        std::unique_lock<std::mutex> lock{ waiter.mutex };
+        waiter.sleeping = true;
+
+        // every push happened before finished_ was set.
+        bool finished = finished_;
+        if ( queue.dequeue( piece ) ) {
+            waiter.sleeping = false;
+            return true;
+        }
+        if ( finished ) {
+            waiter.sleeping = false;
+            return false;
+        }
+
+        waiter.cv.wait( lock, [&waiter] { return waiter.woken; } );
+        waiter.woken = false;
+        waiter.sleeping = false;
+        lock.unlock();
+
+        if ( queue.dequeue( piece ) ) return true;
+    }
+}
+
+void StreamSplitter::write( unsigned w )
+{
+    const static std::string fnname{"StreamSplitter::write"};
+
+    Queue& queue = *queues_[w];
+    Piece piece;
+    std::string ofn;
+    int ofd = -1;
+
+    for ( ;; ) {
+        if ( !queue.dequeue( piece ) && !wait( w, piece ) ) break;
+
+        if ( piece.first ) {
+            if ( ofd >= 0 && ::close( ofd ) != 0 ) {
+                logger_->error( "{} Failed to close destination file: {}", fnname, ofn );
+                failed_ = true;
+            }
+
+            ofn = odname_ + piece.key + ".csv";
+            ofd = ::open( ofn.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+            if ( ofd < 0 || !Transfer::writeAll( ofd, header_.data(), header_.length() ) ) {
+                logger_->error( "{} Failed to open destination file: {}", fnname, ofn );
+                failed_ = true;
+            }
+        }
+
+        if ( ofd >= 0 && !Transfer::writeAll( ofd, piece.buf->data.data() + piece.off, piece.len ) ) {
+            logger_->error( "{} Failed to write {} bytes to: {}", fnname, piece.len, ofn );
+            failed_ = true;
+        }
+
+        // let go of the buffer now, not when the next piece arrives.
+        piece.buf.reset();
+    }
+
+    if ( ofd >= 0 && ::close( ofd ) != 0 ) {
+        logger_->error( "{} Failed to close destination file: {}", fnname, ofn );
+        failed_ = true;
+    }
+}
@@ -0,0 +1,355 @@
+#include "transfer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+bool Transfer::parse( const std::string& name, Method& method )
+{
+    if ( "auto" == name || "copy_file_range" == name ) {
+        method = Method::COPY_FILE_RANGE;
+    } else if ( "sendfile" == name ) {
+        method = Method::SENDFILE;
+    } else if ( "splice" == name ) {
+        method = Method::SPLICE;
+    } else if ( "readwrite" == name ) {
+        method = Method::READWRITE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* Transfer::name( Method method )
+{
+    switch ( method ) {
+        case Method::COPY_FILE_RANGE : return "copy_file_range";
+        case Method::SENDFILE :        return "sendfile";
+        case Method::SPLICE :          return "splice";
+        default :                      return "readwrite";
+    }
+}
+
+Transfer::Transfer( Method method, LogPtr logger ) :
+    method_{ method },
+    logger_{ logger },
+    ifd_{ -1 },
+    pipe_{ -1, -1 },
+    buf_{}
+{
+#ifndef __linux__
+    // the kernel copy methods are linux only.
+    method_ = Method::READWRITE;
+#endif
+}
+
+Transfer::Transfer( Transfer&& other ) :
+    method_{ other.method_ },
+    logger_{ other.logger_ },
+    ifd_{ other.ifd_ },
+    pipe_{ other.pipe_[0], other.pipe_[1] },
+    buf_{ std::move( other.buf_ ) }
+{
+    other.ifd_ = -1;
+    other.pipe_[0] = other.pipe_[1] = -1;
+}
+
+Transfer::~Transfer( void )
+{
+    close();
+}
+
+bool Transfer::open( const std::string& ifname )
+{
+    close();
+    ifd_ = ::open( ifname.c_str(), O_RDONLY );
+    return ifd_ >= 0;
+}
+
+void Transfer::close( void )
+{
+    if ( ifd_ >= 0 ) ::close( ifd_ );
+    ifd_ = -1;
+    closePipe();
+}
+
+void Transfer::closePipe( void )
+{
+    if ( pipe_[0] >= 0 ) ::close( pipe_[0] );
+    if ( pipe_[1] >= 0 ) ::close( pipe_[1] );
+    pipe_[0] = pipe_[1] = -1;
+}
+
+Transfer::Method Transfer::method( void ) const
+{
+    return method_;
+}
+
+bool Transfer::writeAt( int ofd, long ooff, const char* p, long len )
+{
+    while ( len > 0 ) {
+        ssize_t n = pwrite( ofd, p, len, ooff );
+        if ( n < 0 ) {
+            if ( errno == EINTR ) continue;
+            return false;
+        }
+        p += n;
+        ooff += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool Transfer::writeAll( int ofd, const char* p, long len )
+{
+    while ( len > 0 ) {
+        ssize_t n = write( ofd, p, len );
+        if ( n < 0 ) {
+            if ( errno == EINTR ) continue;
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+long Transfer::stream( int ofd, long soff, long len )
+{
+    const static std::string fnname{"Transfer::stream"};
+    long total_bytes{0};
+    ssize_t n;
+    bool kernel = ( method_ != Method::READWRITE );
+
+    while ( total_bytes < len ) {
+#ifdef __linux__
+        if ( kernel ) {
+            off_t in = soff + total_bytes;
+            n = sendfile( ofd, ifd_, &in, len - total_bytes );
+            if ( n < 0 && errno == EINTR ) continue;
+            if ( n < 0 && ( errno == EINVAL || errno == ENOSYS ) ) {
+                // e.g., an output opened with O_APPEND; stay with read/write for the rest of the stream.
+                kernel = false;
+                continue;
+            }
+        } else
+#endif
+        {
+            if ( buf_.empty() ) buf_.resize( BUFSIZE );
+            n = pread( ifd_, buf_.data(), std::min<long>( BUFSIZE, len - total_bytes ), soff + total_bytes );
+            if ( n < 0 && errno == EINTR ) continue;
+            if ( n > 0 && !writeAll( ofd, buf_.data(), n ) ) n = -1;
+        }
+
+        if ( n == 0 ) break;                                    // the input ended.
+
+        if ( n < 0 ) {
+            logger_->error( "{} failed at input offset {}: {}", fnname, soff + total_bytes, std::strerror( errno ) );
+            return -1;
+        }
+
+        total_bytes += n;
+    }
+
+    return total_bytes;
+}
+
+long Transfer::toFile( const std::string& ofn, const std::string& header, long soff, long len )
+{
+    const static std::string fnname{"Transfer::toFile"};
+
+    int ofd = ::open( ofn.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+    if ( ofd < 0 ) {
+        logger_->error( "{} Failed to open destination file: {}", fnname, ofn );
+        return -1;
+    }
+
+    // header includes the newline; the data goes right after it.
+    if ( !writeAt( ofd, 0, header.data(), header.length() ) ) {
+        logger_->error( "{} Failed to write the header to: {}", fnname, ofn );
+        ::close( ofd );
+        return -1;
+    }
+
+    long total_bytes = copy( ofd, header.length(), soff, len );
+
+    if ( ::close( ofd ) != 0 ) {
+        logger_->error( "{} Failed to close destination file: {}", fnname, ofn );
+        return -1;
+    }
+
+    return total_bytes;
+}
+
+bool Transfer::prepare( const std::string& ofn, const std::string& header, long len )
+{
+    const static std::string fnname{"Transfer::prepare"};
+
+    int ofd = ::open( ofn.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+    if ( ofd < 0 ) {
+        logger_->error( "{} Failed to open destination file: {}", fnname, ofn );
+        return false;
+    }
+
+    bool ok = writeAt( ofd, 0, header.data(), header.length() );
+    if ( !ok ) {
+        logger_->error( "{} Failed to write the header to: {}", fnname, ofn );
+    }
+
+    long size = header.length() + len;
+#ifdef __linux__
+    // reserve the blocks up front so the parallel writers do not fragment the file; not every filesystem can.
+    if ( ok && fallocate( ofd, 0, 0, size ) != 0 )
+#endif
+    {
+        if ( ok && ftruncate( ofd, size ) != 0 ) {
+            logger_->error( "{} Failed to size {} to {} bytes: {}", fnname, ofn, size, std::strerror( errno ) );
+            ok = false;
+        }
+    }
+
+    if ( ::close( ofd ) != 0 ) ok = false;
+    return ok;
+}
+
+long Transfer::toFileAt( const std::string& ofn, long ooff, long soff, long len )
+{
+    const static std::string fnname{"Transfer::toFileAt"};
+
+    int ofd = ::open( ofn.c_str(), O_WRONLY );
+    if ( ofd < 0 ) {
+        logger_->error( "{} Failed to open destination file: {}", fnname, ofn );
+        return -1;
+    }
+
+    long total_bytes = copy( ofd, ooff, soff, len );
+
+    if ( ::close( ofd ) != 0 ) {
+        logger_->error( "{} Failed to close destination file: {}", fnname, ofn );
+        return -1;
+    }
+
+    return total_bytes;
+}
+
+long Transfer::copy( int ofd, long ooff, long soff, long len )
+{
+    const static std::string fnname{"Transfer::copy"};
+    long total_bytes{0};
+    long n;
+
+    while ( total_bytes < len ) {
+        n = copyChunk( ofd, ooff + total_bytes, soff + total_bytes, len - total_bytes );
+
+        if ( n == 0 ) break;                                    // the input ended.
+
+        if ( n < 0 ) {
+            if ( errno == EINTR ) continue;
+            if ( fallback( errno ) ) continue;                   // offsets are explicit, so just carry on.
+
+            logger_->error( "{} {} failed at input offset {}: {}", fnname, name( method_ ), soff + total_bytes, std::strerror( errno ) );
+            return -1;
+        }
+
+        total_bytes += n;
+    }
+
+    return total_bytes;
+}
+
+long Transfer::copyChunk( int ofd, long ooff, long soff, long len )
+{
+    switch ( method_ ) {
+#ifdef __linux__
+        case Method::COPY_FILE_RANGE : {
+            loff_t in = soff;
+            loff_t out = ooff;
+            return copy_file_range( ifd_, &in, ofd, &out, len, 0 );
+        }
+
+        case Method::SENDFILE : {
+            // sendfile writes at the file position of ofd.
+            off_t in = soff;
+            if ( lseek( ofd, ooff, SEEK_SET ) < 0 ) return -1;
+            return sendfile( ofd, ifd_, &in, len );
+        }
+
+        case Method::SPLICE :
+            return spliceChunk( ofd, ooff, soff, len );
+#endif
+
+        default :
+            return readWriteChunk( ofd, ooff, soff, len );
+    }
+}
+
+long Transfer::spliceChunk( int ofd, long ooff, long soff, long len )
+{
+#ifdef __linux__
+    if ( pipe_[0] < 0 ) {
+        if ( pipe( pipe_ ) != 0 ) return -1;
+        // a bigger pipe means fewer round trips; this is only a hint.
+        fcntl( pipe_[1], F_SETPIPE_SZ, 1024 * 1024 );
+    }
+
+    loff_t in = soff;
+    ssize_t n = splice( ifd_, &in, pipe_[1], nullptr, len, SPLICE_F_MOVE );
+    if ( n <= 0 ) return n;
+
+    // drain everything that went into the pipe to the output.
+    loff_t out = ooff;
+    ssize_t moved = 0;
+    while ( moved < n ) {
+        ssize_t m = splice( pipe_[0], nullptr, ofd, &out, n - moved, SPLICE_F_MOVE );
+        if ( m < 0 && errno == EINTR ) continue;
+        if ( m <= 0 ) {
+            // the pipe still holds data; throw it away with the pipe.
+            int err = errno;
+            closePipe();
+            errno = err;
+            return -1;
+        }
+        moved += m;
+    }
+
+    return n;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+long Transfer::readWriteChunk( int ofd, long ooff, long soff, long len )
+{
+    if ( buf_.empty() ) buf_.resize( BUFSIZE );
+    if ( len > BUFSIZE ) len = BUFSIZE;
+
+    ssize_t n = pread( ifd_, buf_.data(), len, soff );
+    if ( n <= 0 ) return n;
+
+    if ( !writeAt( ofd, ooff, buf_.data(), n ) ) return -1;
+    return n;
+}
+
+bool Transfer::fallback( int err )
+{
+    const static std::string fnname{"Transfer::fallback"};
+
+    // errors that say "this method cannot do this copy" rather than "the copy failed".
+    if ( err != EXDEV && err != ENOSYS && err != EINVAL && err != EOPNOTSUPP && err != EBADF && err != EPERM ) {
+        return false;
+    }
+
+    if ( method_ == Method::READWRITE ) return false;
+
+    Method next = static_cast<Method>( static_cast<int>( method_ ) + 1 );
+    logger_->info( "{} {} is not usable here ({}); falling back to {}.", fnname, name( method_ ), std::strerror( err ), name( next ) );
+    method_ = next;
+    return true;
+}
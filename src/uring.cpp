@@ -0,0 +1,337 @@
+#include "uring.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef FILESPLITTER_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
+UringOutput::UringOutput( unsigned depth, Transfer& fallback, Transfer::LogPtr logger ) :
+    depth_{ depth > 0 ? depth : 1 },
+    fallback_{ fallback },
+    logger_{ logger },
+    ring_{ -1 },
+    sqentries_{ 0 },
+    cqentries_{ 0 },
+    sqmap_{ nullptr },
+    sqmaplen_{ 0 },
+    cqmap_{ nullptr },
+    cqmaplen_{ 0 },
+    sqemap_{ nullptr },
+    sqemaplen_{ 0 },
+    sqhead_{ nullptr },
+    sqtail_{ nullptr },
+    sqmask_{ nullptr },
+    sqarray_{ nullptr },
+    cqhead_{ nullptr },
+    cqtail_{ nullptr },
+    cqmask_{ nullptr },
+    cqes_{ nullptr },
+    sqes_{ nullptr },
+    base_{ nullptr },
+    ifsize_{ 0 },
+    slots_{},
+    inflight_{ 0 },
+    redone_{ 0 }
+{
+}
+
+UringOutput::~UringOutput( void )
+{
+    close();
+}
+
+#ifdef FILESPLITTER_IO_URING
+
+namespace {
+
+// every chain is openat -> writev -> close; the step is kept in the low bits of the user data.
+constexpr int STEPS = 3;
+
+}  // end anonymous namespace.
+
+bool UringOutput::open( const std::string& ifname, long ifsize )
+{
+    const static std::string fnname{"UringOutput::open"};
+
+    struct io_uring_params params;
+    std::memset( &params, 0, sizeof params );
+
+    ring_ = syscall( __NR_io_uring_setup, depth_ * STEPS, &params );
+    if ( ring_ < 0 ) {
+        logger_->warn( "{} io_uring_setup failed: {}", fnname, std::strerror( errno ) );
+        return false;
+    }
+
+    sqentries_ = params.sq_entries;
+    cqentries_ = params.cq_entries;
+
+    sqmaplen_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqmaplen_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    sqemaplen_ = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    sqmap_ = mmap( nullptr, sqmaplen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_SQ_RING );
+    cqmap_ = mmap( nullptr, cqmaplen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_CQ_RING );
+    sqemap_ = mmap( nullptr, sqemaplen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_SQES );
+
+    if ( sqmap_ == MAP_FAILED || cqmap_ == MAP_FAILED || sqemap_ == MAP_FAILED ) {
+        logger_->warn( "{} unable to map the rings: {}", fnname, std::strerror( errno ) );
+        if ( sqmap_ == MAP_FAILED ) sqmap_ = nullptr;
+        if ( cqmap_ == MAP_FAILED ) cqmap_ = nullptr;
+        if ( sqemap_ == MAP_FAILED ) sqemap_ = nullptr;
+        close();
+        return false;
+    }
+
+    char* sq = static_cast<char*>( sqmap_ );
+    char* cq = static_cast<char*>( cqmap_ );
+    sqhead_ = reinterpret_cast<unsigned*>( sq + params.sq_off.head );
+    sqtail_ = reinterpret_cast<unsigned*>( sq + params.sq_off.tail );
+    sqmask_ = reinterpret_cast<unsigned*>( sq + params.sq_off.ring_mask );
+    sqarray_ = reinterpret_cast<unsigned*>( sq + params.sq_off.array );
+    cqhead_ = reinterpret_cast<unsigned*>( cq + params.cq_off.head );
+    cqtail_ = reinterpret_cast<unsigned*>( cq + params.cq_off.tail );
+    cqmask_ = reinterpret_cast<unsigned*>( cq + params.cq_off.ring_mask );
+    cqes_ = cq + params.cq_off.cqes;
+    sqes_ = sqemap_;
+
+    if ( !supported() ) {
+        logger_->warn( "{} the kernel does not support openat/writev/close through io_uring.", fnname );
+        close();
+        return false;
+    }
+
+    // a sparse table of direct descriptors: one per slot.
+    std::vector<int> files( depth_, -1 );
+    if ( syscall( __NR_io_uring_register, ring_, IORING_REGISTER_FILES, files.data(), depth_ ) != 0 ) {
+        logger_->warn( "{} unable to register the descriptor table: {}", fnname, std::strerror( errno ) );
+        close();
+        return false;
+    }
+
+    // the outputs are written straight out of the page cache through this mapping.
+    int fd = ::open( ifname.c_str(), O_RDONLY );
+    void* p = ( fd >= 0 && ifsize > 0 ) ? mmap( nullptr, ifsize, PROT_READ, MAP_SHARED, fd, 0 ) : MAP_FAILED;
+    if ( fd >= 0 ) ::close( fd );
+    if ( p == MAP_FAILED ) {
+        logger_->warn( "{} unable to map the input file: {}", fnname, ifname );
+        close();
+        return false;
+    }
+
+    base_ = static_cast<const char*>( p );
+    ifsize_ = ifsize;
+    slots_.assign( depth_, Slot{ false, false, 0, 0, 0, std::string{}, nullptr, {} } );
+    inflight_ = 0;
+    redone_ = 0;
+    return true;
+}
+
+bool UringOutput::supported( void )
+{
+    const unsigned nops = 256;
+    std::vector<char> mem( sizeof(struct io_uring_probe) + nops * sizeof(struct io_uring_probe_op), 0 );
+    struct io_uring_probe* probe = reinterpret_cast<struct io_uring_probe*>( mem.data() );
+
+    if ( syscall( __NR_io_uring_register, ring_, IORING_REGISTER_PROBE, probe, nops ) != 0 ) return false;
+
+    const int ops[] = { IORING_OP_OPENAT, IORING_OP_WRITEV, IORING_OP_CLOSE };
+    for ( int op : ops ) {
+        if ( op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED) ) return false;
+    }
+    return true;
+}
+
+void UringOutput::close( void )
+{
+    if ( ring_ >= 0 && base_ ) drain();
+
+    if ( base_ ) munmap( const_cast<char*>( base_ ), ifsize_ );
+    if ( sqemap_ ) munmap( sqemap_, sqemaplen_ );
+    if ( cqmap_ ) munmap( cqmap_, cqmaplen_ );
+    if ( sqmap_ ) munmap( sqmap_, sqmaplen_ );
+    if ( ring_ >= 0 ) ::close( ring_ );         // this also closes anything left in the descriptor table.
+
+    base_ = nullptr;
+    sqemap_ = cqmap_ = sqmap_ = nullptr;
+    ring_ = -1;
+    slots_.clear();
+    inflight_ = 0;
+}
+
+void* UringOutput::nextSqe( void )
+{
+    unsigned tail = *sqtail_;
+    unsigned index = tail & *sqmask_;
+    struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>( sqes_ ) + index;
+
+    std::memset( sqe, 0, sizeof *sqe );
+    sqarray_[index] = index;
+    // the kernel must see the entry before it sees the new tail.
+    __atomic_store_n( sqtail_, tail + 1, __ATOMIC_RELEASE );
+    return sqe;
+}
+
+bool UringOutput::enter( unsigned min_complete )
+{
+    unsigned flags = ( min_complete > 0 ) ? IORING_ENTER_GETEVENTS : 0;
+    // everything between the kernel's head and our tail has not been submitted yet.
+    unsigned to_submit = *sqtail_ - __atomic_load_n( sqhead_, __ATOMIC_ACQUIRE );
+
+    while ( syscall( __NR_io_uring_enter, ring_, to_submit, min_complete, flags, nullptr, 0 ) < 0 ) {
+        if ( errno != EINTR && errno != EAGAIN && errno != EBUSY ) return false;
+    }
+    return true;
+}
+
+long UringOutput::submit( const std::string& ofn, const std::string& header, long soff, long len )
+{
+    const static std::string fnname{"UringOutput::submit"};
+
+    // big copies are better left to copy_file_range, which can avoid touching the data.
+    if ( len > MAXBYTES || soff < 0 || soff + len > ifsize_ ) {
+        return fallback_.toFile( ofn, header, soff, len );
+    }
+
+    // wait for a free slot.
+    while ( inflight_ == depth_ ) {
+        if ( !reap( 1 ) ) {
+            logger_->error( "{} io_uring_enter failed: {}", fnname, std::strerror( errno ) );
+            return -1;
+        }
+    }
+
+    unsigned i = 0;
+    while ( slots_[i].busy ) ++i;
+
+    Slot& slot = slots_[i];
+    slot.busy = true;
+    slot.failed = false;
+    slot.pending = STEPS;
+    slot.soff = soff;
+    slot.len = len;
+    slot.ofn = ofn;
+    slot.header = &header;
+    slot.iov[0].iov_base = const_cast<char*>( header.data() );
+    slot.iov[0].iov_len = header.length();
+    slot.iov[1].iov_base = const_cast<char*>( base_ + soff );
+    slot.iov[1].iov_len = len;
+    ++inflight_;
+
+    struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>( nextSqe() );
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<unsigned long>( slot.ofn.c_str() );
+    sqe->len = 0666;
+    sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC;
+    sqe->file_index = i + 1;                                    // 1-based: install into direct descriptor slot i.
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = i * STEPS + 0;
+
+    sqe = static_cast<struct io_uring_sqe*>( nextSqe() );
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = i;
+    sqe->addr = reinterpret_cast<unsigned long>( slot.iov );
+    sqe->len = 2;
+    sqe->off = 0;
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+    sqe->user_data = i * STEPS + 1;
+
+    sqe = static_cast<struct io_uring_sqe*>( nextSqe() );
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = i + 1;
+    sqe->user_data = i * STEPS + 2;
+
+    // submit, and pick up whatever has already finished without waiting; anything not submitted now is retried by the
+    // next reap.
+    if ( !reap( 0 ) ) {
+        logger_->error( "{} io_uring_enter failed: {}", fnname, std::strerror( errno ) );
+    }
+    return len;
+}
+
+bool UringOutput::reap( unsigned min_complete )
+{
+    bool ok = enter( min_complete );
+
+    unsigned head = *cqhead_;
+    unsigned tail = __atomic_load_n( cqtail_, __ATOMIC_ACQUIRE );
+
+    while ( head != tail ) {
+        struct io_uring_cqe* cqe = static_cast<struct io_uring_cqe*>( cqes_ ) + (head & *cqmask_);
+        Slot& slot = slots_[cqe->user_data / STEPS];
+        int step = cqe->user_data % STEPS;
+
+        if ( cqe->res < 0 || ( step == 1 && static_cast<size_t>( cqe->res ) != slot.iov[0].iov_len + slot.iov[1].iov_len ) ) {
+            slot.failed = true;
+        }
+
+        if ( --slot.pending == 0 ) finish( slot );
+        ++head;
+    }
+
+    __atomic_store_n( cqhead_, head, __ATOMIC_RELEASE );
+    return ok;
+}
+
+void UringOutput::finish( Slot& slot )
+{
+    const static std::string fnname{"UringOutput::finish"};
+
+    if ( slot.failed ) {
+        // a failed or short step cancels the rest of the chain; just write this output the ordinary way.
+        logger_->warn( "{} io_uring chain for {} failed; rewriting it synchronously.", fnname, slot.ofn );
+        ++redone_;
+        if ( fallback_.toFile( slot.ofn, *slot.header, slot.soff, slot.len ) != slot.len ) {
+            logger_->error( "{} unable to write {}", fnname, slot.ofn );
+        }
+    }
+
+    slot.busy = false;
+    --inflight_;
+}
+
+long UringOutput::drain( void )
+{
+    const static std::string fnname{"UringOutput::drain"};
+
+    while ( inflight_ > 0 ) {
+        if ( !reap( 1 ) ) {
+            logger_->error( "{} io_uring_enter failed with {} outputs in flight: {}", fnname, inflight_, std::strerror( errno ) );
+            return inflight_ + redone_;
+        }
+    }
+
+    long redone = redone_;
+    redone_ = 0;
+    return redone;
+}
+
+#else
+
+bool UringOutput::open( const std::string&, long )
+{
+    logger_->warn( "UringOutput::open this build does not include io_uring support." );
+    return false;
+}
+
+void UringOutput::close( void )
+{
+}
+
+long UringOutput::submit( const std::string& ofn, const std::string& header, long soff, long len )
+{
+    return fallback_.toFile( ofn, header, soff, len );
+}
+
+long UringOutput::drain( void )
+{
+    return 0;
+}
+
+#endif